@@ -0,0 +1,126 @@
+#include "ADCScanner.h"
+
+#ifndef NATIVE
+
+static ADCScanner *scanner;
+
+void ADCScanner::begin(const int *pins, int count) {
+    scanner = this;
+    pinCount = count;
+
+    uint32_t channels[2][ADC_SCANNER_MAX_PINS];
+    uint32_t configs[2][ADC_SCANNER_MAX_PINS];
+
+    // The core knows which ADC, channel and mux each pin uses, so read each
+    // pin once with both ADCs off and keep what the core set on the one it used
+    for (int i = 0; i < pinCount; i++) {
+        ADC0_SC1A = ADC_SC1_ADCH(31);
+        ADC1_SC1A = ADC_SC1_ADCH(31);
+
+        analogRead(pins[i]);
+
+        int adc = (ADC1_SC1A & ADC_SC1_ADCH(31)) != ADC_SC1_ADCH(31) ? 1 : 0;
+
+        pinADCs[i] = adc;
+        pinIndexes[i] = adcPinCounts[adc];
+
+        channels[adc][adcPinCounts[adc]] = (adc == 0 ? ADC0_SC1A : ADC1_SC1A) & ADC_SC1_ADCH(31);
+        configs[adc][adcPinCounts[adc]] = adc == 0 ? ADC0_CFG2 : ADC1_CFG2;
+
+        adcPinCounts[adc]++;
+    }
+
+    for (int adc = 0; adc < 2; adc++) {
+        int n = adcPinCounts[adc];
+
+        if (n == 0) {
+            continue;
+        }
+
+        usedADCs |= 1 << adc;
+
+        for (int i = 0; i < n; i++) {
+            nextChannels[adc][i] = channels[adc][(i + 1) % n];
+            nextConfigs[adc][i] = configs[adc][(i + 1) % n];
+        }
+
+        volatile uint32_t &sc1a = adc == 0 ? ADC0_SC1A : ADC1_SC1A;
+        volatile uint32_t &cfg2 = adc == 0 ? ADC0_CFG2 : ADC1_CFG2;
+
+        // Conversion complete requests the result, which then links to the
+        // mux and then the channel of the next pin, starting it
+        resultDMA[adc].source((volatile uint16_t &)(adc == 0 ? ADC0_RA : ADC1_RA));
+        resultDMA[adc].destinationBuffer(results[adc], 2 * n * sizeof(uint16_t));
+        resultDMA[adc].triggerAtHardwareEvent(adc == 0 ? DMAMUX_SOURCE_ADC0 : DMAMUX_SOURCE_ADC1);
+        resultDMA[adc].interruptAtHalf();
+        resultDMA[adc].interruptAtCompletion();
+        resultDMA[adc].attachInterrupt(adc == 0 ? adc0Complete : adc1Complete);
+
+        configDMA[adc].sourceBuffer(nextConfigs[adc], n * sizeof(uint32_t));
+        configDMA[adc].destination(cfg2);
+        configDMA[adc].triggerAtTransfersOf(resultDMA[adc]);
+        configDMA[adc].triggerAtCompletionOf(resultDMA[adc]);
+
+        channelDMA[adc].sourceBuffer(nextChannels[adc], n * sizeof(uint32_t));
+        channelDMA[adc].destination(sc1a);
+        channelDMA[adc].triggerAtTransfersOf(configDMA[adc]);
+        channelDMA[adc].triggerAtCompletionOf(configDMA[adc]);
+
+        channelDMA[adc].enable();
+        configDMA[adc].enable();
+        resultDMA[adc].enable();
+
+        (adc == 0 ? ADC0_SC2 : ADC1_SC2) |= ADC_SC2_DMAEN;
+
+        cfg2 = configs[adc][0];
+        sc1a = channels[adc][0];
+    }
+}
+
+void ADCScanner::adc0Complete() {
+    scanner->halfComplete(0);
+}
+
+void ADCScanner::adc1Complete() {
+    scanner->halfComplete(1);
+}
+
+void ADCScanner::halfComplete(int adc) {
+    resultDMA[adc].clearInterrupt();
+
+    // The count goes down through the buffer and reloads at the end, so past
+    // halfway it is the second half that has just filled. The channel link
+    // to configDMA shares CITER, so only the count bits are compared
+    int count = resultDMA[adc].TCD->CITER & DMA_TCD_CITER_ELINKYES_CITER_MASK;
+    filledHalves[adc] = count > adcPinCounts[adc] ? 1 : 0;
+    readyADCs |= 1 << adc;
+
+    if (readyADCs == usedADCs) {
+        frameHalves[0] = filledHalves[0];
+        frameHalves[1] = filledHalves[1];
+        readyADCs = 0;
+
+        frames++;
+    }
+}
+
+bool ADCScanner::frameReady() {
+    return frames != framesRead;
+}
+
+void ADCScanner::read(uint16_t *values) {
+    noInterrupts();
+
+    uint8_t halves[2] = {frameHalves[0], frameHalves[1]};
+    framesRead = frames;
+
+    interrupts();
+
+    // The DMA is a whole frame away from coming back to these halves
+    for (int i = 0; i < pinCount; i++) {
+        int adc = pinADCs[i];
+        values[i] = results[adc][halves[adc] * adcPinCounts[adc] + pinIndexes[i]];
+    }
+}
+
+#endif
@@ -0,0 +1,62 @@
+/* Continuous scan of analog pins with both ADCs of the Teensy 3.5
+ *
+ * Each ADC converts its share of the pins in a loop without the CPU. When a
+ * conversion completes, one DMA channel moves the result out and then chains
+ * to two more that set the next pin's mux and start its conversion. Results
+ * go into a double buffer per ADC, and a frame is complete once every ADC has
+ * filled a half, which the loop picks up with frameReady() and read().
+ */
+
+#ifndef ADC_SCANNER_H
+#define ADC_SCANNER_H
+
+#include <Arduino.h>
+
+#ifndef NATIVE
+
+#include <DMAChannel.h>
+
+#define ADC_SCANNER_MAX_PINS 32
+
+class ADCScanner {
+public:
+    ADCScanner() {}
+    void begin(const int *pins, int count);
+
+    bool frameReady();
+    void read(uint16_t *values);
+
+private:
+    static void adc0Complete();
+    static void adc1Complete();
+    void halfComplete(int adc);
+
+    int pinCount = 0;
+
+    // Which ADC each pin is on and its position in that ADC's scan
+    uint8_t pinADCs[ADC_SCANNER_MAX_PINS];
+    uint8_t pinIndexes[ADC_SCANNER_MAX_PINS];
+    int adcPinCounts[2] = {0};
+    uint8_t usedADCs = 0;
+
+    // SC1A and CFG2 for each pin after the one converting, as the DMA writes them
+    uint32_t nextChannels[2][ADC_SCANNER_MAX_PINS];
+    uint32_t nextConfigs[2][ADC_SCANNER_MAX_PINS];
+
+    volatile uint16_t results[2][2 * ADC_SCANNER_MAX_PINS];
+
+    DMAChannel resultDMA[2];
+    DMAChannel configDMA[2];
+    DMAChannel channelDMA[2];
+
+    // Half of each ADC's buffer in the last complete frame
+    volatile uint8_t frameHalves[2] = {0};
+    volatile uint8_t filledHalves[2] = {0};
+    volatile uint8_t readyADCs = 0;
+    volatile uint32_t frames = 0;
+    uint32_t framesRead = 0;
+};
+
+#endif
+
+#endif // ADC_SCANNER_H
@@ -1,13 +1,20 @@
 #ifndef BALL_DATA_H
 #define BALL_DATA_H
 
+#include <Config.h>
+
 typedef struct BallData {
     int angle;
     int strength;
     bool visible;
 
+    // Degrees per second clockwise and cm, from the TSOP slave's ball tracker
+    int angularVelocity = 0;
+    int range = TSOP_NO_RANGE;
+
     BallData() {}
     BallData(int a, int s, bool v) : angle(a), strength(s), visible(v) {}
+    BallData(int a, int s, bool v, int av, int r) : angle(a), strength(s), visible(v), angularVelocity(av), range(r) {}
 } BallData;
 
 #endif // BALL_DATA_H
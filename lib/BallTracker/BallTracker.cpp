@@ -0,0 +1,68 @@
+#include "BallTracker.h"
+
+void BallTracker::update(int measuredAngle, int measuredStrength) {
+    unsigned long currentTime = micros();
+    float elapsedTime = (currentTime - lastTime) / 1000000.0f;
+    lastTime = currentTime;
+
+    if (measuredAngle == TSOP_NO_BALL) {
+        tracking = false;
+        return;
+    }
+
+    if (!tracking) {
+        angle = measuredAngle;
+        angularVelocity = 0;
+        strength = measuredStrength;
+        tracking = true;
+        return;
+    }
+
+    if (elapsedTime <= 0) {
+        return;
+    }
+
+    float predictedAngle = angle + angularVelocity * elapsedTime;
+
+    // Smallest signed difference between the measurement and the prediction
+    float residual = fmodf(measuredAngle - predictedAngle + 540.0f, 360.0f) - 180.0f;
+
+    if (fabsf(residual) > TSOP_TRACK_GATE) {
+        // Too far from the prediction to be the same motion, start again from here
+        angle = measuredAngle;
+        angularVelocity = 0;
+    } else {
+        // Critically damped gains for TSOP_TRACK_TIME, fixed gains would follow
+        // the noise more closely the more often the TSOPs are read
+        float decay = expf(-elapsedTime * 1000000.0f / TSOP_TRACK_TIME);
+        float alpha = 1 - decay * decay;
+        float beta = (1 - decay) * (1 - decay);
+
+        angle = predictedAngle + alpha * residual;
+        angularVelocity += beta * residual / elapsedTime;
+    }
+
+    angle = fmodf(angle + 360.0f, 360.0f);
+
+    float strengthAlpha = 1 - expf(-elapsedTime * 1000000.0f / TSOP_TRACK_STRENGTH_TIME);
+    strength += strengthAlpha * (measuredStrength - strength);
+}
+
+int BallTracker::getAngle() {
+    return tracking ? mod((int)roundf(angle), 360) : TSOP_NO_BALL;
+}
+
+int BallTracker::getAngularVelocity() {
+    return tracking ? (int)roundf(angularVelocity) : 0;
+}
+
+int BallTracker::getRange() {
+    // Strength falls off roughly exponentially with distance
+    if (!tracking || strength <= 0) {
+        return TSOP_NO_RANGE;
+    }
+
+    float range = (float)TSOP_RANGE_FALLOFF * logf((float)TSOP_RANGE_CONTACT_STRENGTH / strength);
+
+    return constrain((int)roundf(range), 0, TSOP_NO_RANGE);
+}
@@ -0,0 +1,33 @@
+/* Library for tracking the ball between TSOP reads
+ *
+ * An alpha-beta filter on the ball's bearing estimates its angular velocity,
+ * and the strength is smoothed and converted to an approximate range.
+ */
+
+#ifndef BALL_TRACKER_H
+#define BALL_TRACKER_H
+
+#include <Arduino.h>
+#include <Common.h>
+#include <Config.h>
+
+class BallTracker {
+public:
+    BallTracker() {}
+    void update(int measuredAngle, int measuredStrength);
+
+    int getAngle();
+    int getAngularVelocity();
+    int getRange();
+
+private:
+    bool tracking = false;
+    unsigned long lastTime = 0;
+
+    // Degrees, degrees per second and counts
+    float angle = 0;
+    float angularVelocity = 0;
+    float strength = 0;
+};
+
+#endif // BALL_TRACKER_H
@@ -35,6 +35,13 @@ public:
 
         return (BluetoothData) {BluetoothDataType::noData, 0, ""};
     }
+
+    static int receiveCommand() {
+        // One byte or -1, unlike receive() this never waits on the serial
+        // timeout. Anything that isn't a command is read and dropped so it
+        // can't hold up the commands behind it
+        return Serial5.available() ? Serial5.read() : -1;
+    }
 };
 
 #endif
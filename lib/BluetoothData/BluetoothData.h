@@ -14,7 +14,8 @@ enum BluetoothDataType: int {
     btRobotPosition,
     settings,
     orbitAngle,
-    goal
+    goal,
+    profile
 };
 
 typedef struct BluetoothData {
@@ -1,5 +1,8 @@
 #include "Common.h"
 
+#include <stdint.h>
+#include <stdlib.h>
+
 // int len(int array[]){
 //     return ARRAYLENGTH(array);
 // }
@@ -34,6 +37,39 @@ double smallestAngleBetween(double angle1, double angle2) {
     return fmin(ang, 360 - ang);
 }
 
+int atan2Degrees(int y, int x) {
+    /* Integer atan2 in whole degrees from 0 to 359, accurate to about 0.1
+     * degrees before rounding. Uses atan(z) = 45z - z(z - 1)(14.02 + 3.80z)
+     * in Q12 on the first octant
+     */
+    int absX = abs(x);
+    int absY = abs(y);
+
+    if (absX == 0 && absY == 0) {
+        return 0;
+    }
+
+    bool swapped = absY > absX;
+    int64_t numerator = swapped ? absX : absY;
+    int denominator = swapped ? absY : absX;
+
+    int z = (int)((numerator << 12) / denominator);
+    int octant = 45 * z + (int)(((int64_t)z * (4096 - z) >> 12) * (57426 + ((z * 15565) >> 12)) >> 12);
+
+    // Q12 degrees
+    int result = swapped ? 90 * 4096 - octant : octant;
+
+    if (x < 0) {
+        result = 180 * 4096 - result;
+    }
+
+    if (y < 0) {
+        result = 360 * 4096 - result;
+    }
+
+    return mod((result + 2048) >> 12, 360);
+}
+
 double midAngleBetween(double angleCounterClockwise, double angleClockwise) {
     return mod(angleCounterClockwise + angleBetween(angleCounterClockwise, angleClockwise) / 2.0, 360);
 }
@@ -5,6 +5,7 @@
 #define COMMON_H
 
 #include <math.h>
+#include <stdint.h>
 
 #define TO_RADIANS 0.01745329251994329576923690768489
 
@@ -20,6 +21,63 @@
         for (int q = upper; q >= lower; q--){     \
             *(a + q + 1) = *(a + q); }}}
 
+/* Selects the K greatest positive values of an N value array, greatest
+ * first, along with their indexes. Equal values keep their order and
+ * unfilled places are left as value 0 at index 0.
+ */
+template <int K, int N>
+void selectGreatest(const int *values, int *greatestValues, int *greatestIndexes) {
+    for (int j = 0; j < K; j++) {
+        greatestValues[j] = 0;
+        greatestIndexes[j] = 0;
+    }
+
+    for (int i = 0; i < N; i++) {
+        int value = values[i];
+
+        if (value <= greatestValues[K - 1]) {
+            continue;
+        }
+
+        int j = K - 1;
+
+        while (j > 0 && value > greatestValues[j - 1]) {
+            greatestValues[j] = greatestValues[j - 1];
+            greatestIndexes[j] = greatestIndexes[j - 1];
+            j--;
+        }
+
+        greatestValues[j] = value;
+        greatestIndexes[j] = i;
+    }
+}
+
+/* Bit-sliced counters, bit i of planes[j] is bit j of counter i. Adding a
+ * sample adds its bit i to counter i, for all the counters at once with a
+ * carry rippling through the B planes
+ */
+template <int B>
+void addToCounters(uint32_t *planes, uint32_t sample) {
+    uint32_t carry = sample;
+
+    for (int j = 0; j < B && carry != 0; j++) {
+        uint32_t nextCarry = planes[j] & carry;
+        planes[j] ^= carry;
+        carry = nextCarry;
+    }
+}
+
+template <int B>
+int counterValue(const uint32_t *planes, int i) {
+    int value = 0;
+
+    for (int j = 0; j < B; j++) {
+        value |= ((planes[j] >> i) & 1) << j;
+    }
+
+    return value;
+}
+
 // int len(int array[]);
 
 // template <typename T,unsigned S>
@@ -52,6 +110,35 @@ int sign(int value);
 
 int sign(double value);
 
+int atan2Degrees(int y, int x);
+
+// Sine of 0 to 90 degrees in Q14
+constexpr int16_t SIN_TABLE[91] = {
+    0, 286, 572, 857, 1143, 1428, 1713, 1997, 2280, 2563,
+    2845, 3126, 3406, 3686, 3964, 4240, 4516, 4790, 5063, 5334,
+    5604, 5872, 6138, 6402, 6664, 6924, 7182, 7438, 7692, 7943,
+    8192, 8438, 8682, 8923, 9162, 9397, 9630, 9860, 10087, 10311,
+    10531, 10749, 10963, 11174, 11381, 11585, 11786, 11982, 12176, 12365,
+    12551, 12733, 12911, 13085, 13255, 13421, 13583, 13741, 13894, 14044,
+    14189, 14330, 14466, 14598, 14726, 14849, 14968, 15082, 15191, 15296,
+    15396, 15491, 15582, 15668, 15749, 15826, 15897, 15964, 16026, 16083,
+    16135, 16182, 16225, 16262, 16294, 16322, 16344, 16362, 16374, 16382,
+    16384
+};
+
+constexpr int fixedSinFolded(int degrees) {
+    return degrees <= 90 ? SIN_TABLE[degrees] : (degrees <= 180 ? SIN_TABLE[180 - degrees] : (degrees <= 270 ? -SIN_TABLE[degrees - 180] : -SIN_TABLE[360 - degrees]));
+}
+
+// Sine and cosine of whole degrees in Q14
+constexpr int fixedSin(int degrees) {
+    return fixedSinFolded((degrees % 360 + 360) % 360);
+}
+
+constexpr int fixedCos(int degrees) {
+    return fixedSin(degrees + 90);
+}
+
 double degreesToRadians(double degrees);
 double radiansToDegrees(double radians);
 
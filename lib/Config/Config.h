@@ -12,6 +12,18 @@
 
 #define SPI_DELAY 10
 
+// Snapshot frames read from the slaves with SlaveCommand::snapshotFrame, the
+// last word holds a SLAVE_FRAME_SEQUENCE_BITS sequence number above a CRC-12
+#define SLAVE_FRAME_FILL 0xFFFF
+#define SLAVE_FRAME_DATA_LENGTH 3
+#define SLAVE_FRAME_LENGTH (SLAVE_FRAME_DATA_LENGTH + 1)
+#define SLAVE_FRAME_SEQUENCE_BITS 4
+
+// The slaves answer two words late, so a burst is the same six words as two
+// single word transactions
+#define SLAVE_FRAME_OFFSET 2
+#define SLAVE_BURST_LENGTH (SLAVE_FRAME_OFFSET + SLAVE_FRAME_LENGTH)
+
 // Light Sensors
 
 #define LS_NUM 24
@@ -19,6 +31,33 @@
 #define LS_CALIBRATION_COUNT 10
 #define LS_CALIBRATION_BUFFER 35
 
+// Each sensor follows its own green and white levels and puts its threshold
+// halfway between them, as readings are classified they move the level they
+// were classified as by 1 / 2^LS_LEVEL_SHIFT every LS_LEVEL_UPDATE_TIME us.
+// Readings must cross the threshold by the contrast between the levels /
+// LS_HYSTERESIS_DIVISOR to change, and only move a level once they have
+#define LS_ADAPTIVE_THRESHOLDS true
+#define LS_LEVEL_UPDATE_TIME 1000
+#define LS_LEVEL_SHIFT 5
+#define LS_MIN_CONTRAST (2 * LS_CALIBRATION_BUFFER)
+#define LS_HYSTERESIS_DIVISOR 16
+
+// Find the line clusters with bit operations on a mask of the sensors
+#define LS_BITMASK_CLUSTERS true
+#define LS_MASK ((1UL << LS_NUM) - 1)
+
+// Work out the line in integers with the sizes from a table made at boot
+#define LS_LINE_TABLE true
+
+// Have both ADCs scan the light sensors by DMA (Teensy only), off until it
+// has run on a board
+#define LS_DMA_SCAN false
+
+// Place the line's edges between sensors from how white the sensors either
+// side of each edge read (needs LS_LINE_TABLE). Only worth it when each
+// sensor sees about as far as the gap to the next one
+#define LS_ANALOG_EDGES false
+
 #define NO_LINE_ANGLE 400
 #define NO_LINE_SIZE 3
 
@@ -30,8 +69,14 @@
 #define OVER_LINE_SPEED 255
 #define LINE_SPEED 255
 
-#define LINE_SMALL_SIZE 0.4
-#define LINE_BIG_SIZE 0.7
+// Analog edges measure the size closer, so the line can be let nearer
+#if LS_ANALOG_EDGES
+    #define LINE_SMALL_SIZE 0.5
+    #define LINE_BIG_SIZE 0.8
+#else
+    #define LINE_SMALL_SIZE 0.4
+    #define LINE_BIG_SIZE 0.7
+#endif
 
 #define AVOID_LINE true
 
@@ -46,7 +91,23 @@
 
 #define TSOP_LOOP_COUNT 255
 
+// Time between samples taken by the sampler timer in microseconds
+#define TSOP_SAMPLE_TIME 4
+
+// Count the samples with bit-sliced counters, TSOP_COUNTER_BITS must be able to hold TSOP_LOOP_COUNT + 1
+#define TSOP_SWAR_COUNTERS true
+#define TSOP_COUNTER_BITS 9
+
+// Refresh the TSOPs every sub-frame from the counts of the last TSOP_SUB_FRAMES
+// sub-frames instead of once per TSOP_LOOP_COUNT + 1 samples
+#define TSOP_SLIDING_WINDOW true
+#define TSOP_SUB_FRAMES 4
+
 #define TSOP_UNLOCK_DELAY 2
+#define TSOP_POWER_GROUPS 4
+
+// Samples taken with each power group off and on when finding which TSOPs it powers at boot
+#define TSOP_DETECT_SAMPLES 256
 
 #define TSOP_BEST_TSOP_NO_ANGLE 5
 #define TSOP_BEST_TSOP_NO_STRENGTH 2
@@ -58,16 +119,42 @@
 #define TSOP_MIN_IGNORE 50
 #define TSOP_MAX_IGNORE 220
 
+// Sum the best TSOPs as vectors instead of averaging their indexes
+#define TSOP_VECTOR_ANGLE true
+
 #define TSOP_FIRST_TSOP_WEIGHT 3
 #define TSOP_SECOND_TSOP_WEIGHT 2
 
 #define TSOP_FILTER_NOISE true
 #define TSOP_FILTER_SURROUNDING true
 
+// Per-TSOP gain and offset, fitted by spinning on the spot next to a stationary
+// ball about 30 cm away and stored in the TSOP slave's EEPROM
+#define TSOP_CALIBRATION true
+#define TSOP_CALIBRATION_EEPROM 16
+#define TSOP_CALIBRATION_KEY 0x7C01
+#define TSOP_CALIBRATION_COMMAND 'c'
+#define TSOP_CALIBRATION_TURNS 3
+
+// A TSOP needing a gain outside this range is faulty, so the calibration is rejected
+#define TSOP_CALIBRATION_MIN_GAIN 0.25
+#define TSOP_CALIBRATION_MAX_GAIN 4.0
+
 #define TSOP_NO_BALL 400
 
 #define TSOP_HAS_BALL_STRENGTH 130
 
+// Ball tracking on the TSOP slave. The gains come from these time constants (us)
+// and the time between reads, so they don't depend on how often the TSOPs are read
+#define TSOP_TRACK_TIME 5000
+#define TSOP_TRACK_STRENGTH_TIME 5000
+#define TSOP_TRACK_GATE 60
+
+// Range in cm from strength = TSOP_RANGE_CONTACT_STRENGTH * e^(-range / TSOP_RANGE_FALLOFF)
+#define TSOP_RANGE_CONTACT_STRENGTH 170.0
+#define TSOP_RANGE_FALLOFF 150.0
+#define TSOP_NO_RANGE 1000
+
 // IMU
 
 #define HEADING_KP 4.0
@@ -75,11 +162,51 @@
 #define HEADING_KD 0.3
 #define HEADING_MAX_CORRECTION 180
 
-#define IMU_CALIBRATION_COUNT 20
-#define IMU_CALIBRATION_TIME 50
+// The gyro bias is learnt from windows of IMU_BIAS_WINDOW samples taken while
+// the motors are idle, if the variance and the change from the last window
+// (both in degrees/second) show the robot really was still. Rotations up to
+// IMU_BIAS_MAX_ROTATION can't overcome the motors' friction so count as idle.
+// A steady turn passes both checks, so means beyond the MPU9250's zero rate
+// offset (IMU_BIAS_MAX) are taken as the robot being pushed round
+#define IMU_BIAS_MAX_ROTATION 10
+#define IMU_BIAS_MAX 5
+#define IMU_BIAS_WINDOW 100
+#define IMU_BIAS_MAX_VARIANCE 0.05
+#define IMU_BIAS_MAX_CHANGE 0.02
+#define IMU_BIAS_GAIN 0.2
+#define IMU_CALIBRATION_TIMEOUT 1000
 #define IMU_THRESHOLD 1000
 
+// Integrate every gyro sample from the MPU9250's FIFO instead of one per loop
+#define IMU_FIFO true
+#define IMU_SAMPLE_TIME 1000
+#define IMU_FIFO_BURST 128
+
+// Magnetometer, fused with the gyro heading once it has been calibrated by
+// spinning on the spot. IMU_MAG_WEIGHT of the difference is corrected per reading
+#define IMU_MAG_FUSION true
+#define IMU_MAG_UPDATE_TIME 10000
+#define IMU_MAG_WEIGHT 0.01
+#define IMU_MAG_MIN_RANGE 20
+#define IMU_MAG_CALIBRATION_EEPROM 32
+#define IMU_MAG_CALIBRATION_KEY 0x4D01
+#define IMU_MAG_CALIBRATION_COMMAND 'm'
+#define IMU_MAG_CALIBRATION_TURNS 2
+
+// Rotation speed when spinning on the spot to calibrate
+#define CALIBRATION_ROTATION 60
+
+// Longest a calibration turn may take before the calibration is abandoned (us)
+#define CALIBRATION_TURN_TIMEOUT 5000000
+
+// I2C bus clock, the IMU and Pixy both run at fast mode
+#define I2C_RATE 400000
+
 #define MPU9250_ADDRESS 0x68
+#define MPU9250_GYRO_Z 0x47
+#define MPU9250_FIFO_COUNT 0x72
+#define MPU9250_FIFO_DATA 0x74
+#define MPU9250_FIFO_SIZE 512
 #define MAG_ADDRESS 0x0C
 
 #define GYRO_FULL_SCALE_250_DPS 0x00
@@ -108,6 +235,9 @@
 
 #define BALL_FRONT_BUFFER 10
 
+// Seconds ahead of the tracked ball to aim when orbiting
+#define ORBIT_LEAD_TIME 0.1
+
 // Defence
 
 #define DEFEND_SHORT_STRENGTH 135
@@ -197,6 +327,12 @@
 #define LED_BLINK_TIME_SLAVE_TSOP 300000
 #define LED_BLINK_TIME_SLAVE_LIGHT 700000
 
+// Profiler
+
+#define PROFILER_ENABLED true
+#define PROFILER_RING_SIZE 256
+#define PROFILER_DUMP_COMMAND 'p'
+
 // XBee
 
 #define XBEE_ENABLED true
@@ -212,4 +348,11 @@
 
 #define MOTOR_ANGLE 40
 
+// Ramp the wheels towards their commanded speeds instead of jumping there.
+// The acceleration is in speed (out of 255) per second and the jerk in speed
+// per second squared, a jerk of 0 starts ramping at full acceleration
+#define MOTOR_RAMP true
+#define MOTOR_MAX_ACCELERATION 1500
+#define MOTOR_MAX_JERK 15000
+
 #endif // CONFIG_H
@@ -185,3 +185,7 @@ void DebugController::appSendRobotPosition(double lineAngle, double lineSize) {
     String sendString = String(lineAngle) + "," + String(lineSize);
     Bluetooth::send(sendString, BluetoothDataType::btRobotPosition);
 }
+
+void DebugController::appSendProfile(String profile) {
+    Bluetooth::send(profile, BluetoothDataType::profile);
+}
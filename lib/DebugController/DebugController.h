@@ -44,6 +44,7 @@ public:
     void appSendLightSensors(uint16_t first16Bit, uint16_t second16Bit);
     void appSendPixy(double x, double y, double width, double height);
     void appSendRobotPosition(double lineAngle, double lineSize);
+    void appSendProfile(String profile);
 };
 
 #endif
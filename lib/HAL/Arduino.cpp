@@ -0,0 +1,108 @@
+#include "Arduino.h"
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+HardwareSerial Serial3(3);
+HardwareSerial Serial4(4);
+HardwareSerial Serial5(5);
+HardwareSerial Serial6(6);
+
+String::String(double number, int decimals) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", decimals, number);
+    value = buffer;
+}
+
+int String::indexOf(char c) const {
+    size_t index = value.find(c);
+    return index == std::string::npos ? -1 : (int)index;
+}
+
+String String::substring(unsigned int from) const {
+    return from < value.length() ? String(value.substr(from)) : String();
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+    return from < value.length() && from < to ? String(value.substr(from, to - from)) : String();
+}
+
+long String::toInt() const {
+    return atol(value.c_str());
+}
+
+String HardwareSerial::readString() {
+    String string;
+
+    while (available()) {
+        string += String((char)read());
+    }
+
+    return string;
+}
+
+size_t HardwareSerial::write(uint8_t data) {
+    HAL::backend()->uartWrite(port, data);
+    return 1;
+}
+
+size_t HardwareSerial::write(const char *string) {
+    size_t n = 0;
+
+    while (string[n] != '\0') {
+        write((uint8_t)string[n]);
+        n++;
+    }
+
+    return n;
+}
+
+IntervalTimer *IntervalTimer::timers[HAL_NUM_TIMERS] = {nullptr};
+
+bool IntervalTimer::begin(void (*function)(), uint32_t microseconds) {
+    end();
+
+    for (int i = 0; i < HAL_NUM_TIMERS; i++) {
+        if (timers[i] == nullptr) {
+            callback = function;
+            period = microseconds;
+            lastTime = micros();
+            timers[i] = this;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void IntervalTimer::end() {
+    for (int i = 0; i < HAL_NUM_TIMERS; i++) {
+        if (timers[i] == this) {
+            timers[i] = nullptr;
+        }
+    }
+}
+
+void IntervalTimer::update() {
+    uint32_t now = micros();
+
+    for (int i = 0; i < HAL_NUM_TIMERS; i++) {
+        if (timers[i] != nullptr && now - timers[i]->lastTime >= timers[i]->period) {
+            timers[i]->lastTime = now;
+            timers[i]->callback();
+        }
+    }
+}
+
+int main() {
+    setup();
+
+    while (HAL::backend()->running()) {
+        loop();
+        IntervalTimer::update();
+        HAL::backend()->loopComplete();
+    }
+
+    return 0;
+}
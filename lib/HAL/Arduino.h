@@ -0,0 +1,224 @@
+/* Native replacement for the Teensy Arduino core.
+ *
+ * Only the parts of the Arduino API used by this project are provided. Every
+ * hardware access is forwarded to the active HALBackend.
+ */
+
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <type_traits>
+
+#include "HAL.h"
+
+#define HIGH 1
+#define LOW 0
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define LED_BUILTIN 13
+
+// Analog pins are numbered away from the digital pins so that they never
+// alias in the HAL pin tables
+#define A0 64
+#define A1 65
+#define A2 66
+#define A3 67
+#define A4 68
+#define A5 69
+#define A6 70
+#define A7 71
+#define A8 72
+#define A9 73
+#define A10 74
+#define A11 75
+#define A12 76
+#define A13 77
+#define A14 78
+#define A15 79
+#define A16 80
+#define A17 81
+#define A18 82
+#define A19 83
+#define A20 84
+#define A21 85
+#define A22 86
+#define A23 87
+#define A24 88
+#define A25 89
+#define A26 90
+
+#define IRQ_SPI0 26
+#define NVIC_ENABLE_IRQ(irq)
+#define NVIC_DISABLE_IRQ(irq)
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+template <typename T, typename L, typename H>
+inline T constrain(T value, L low, H high) {
+    return value < low ? (T)low : (value > high ? (T)high : value);
+}
+
+template <typename A, typename B>
+inline typename std::common_type<A, B>::type min(A a, B b) {
+    return a < b ? a : b;
+}
+
+template <typename A, typename B>
+inline typename std::common_type<A, B>::type max(A a, B b) {
+    return a > b ? a : b;
+}
+
+inline void pinMode(uint8_t pin, uint8_t mode) {
+    HAL::backend()->pinMode(pin, mode);
+}
+
+inline uint8_t digitalRead(uint8_t pin) {
+    return HAL::backend()->digitalRead(pin);
+}
+
+inline void digitalWrite(uint8_t pin, uint8_t value) {
+    HAL::backend()->digitalWrite(pin, value);
+}
+
+inline int analogRead(uint8_t pin) {
+    return HAL::backend()->analogRead(pin);
+}
+
+inline void analogWrite(uint8_t pin, int value) {
+    HAL::backend()->analogWrite(pin, value);
+}
+
+inline void analogWriteFrequency(uint8_t pin, float frequency) {}
+
+inline uint32_t micros() {
+    return HAL::backend()->micros();
+}
+
+inline uint32_t millis() {
+    return HAL::backend()->micros() / 1000;
+}
+
+inline void delayMicroseconds(uint32_t duration) {
+    HAL::backend()->delayMicroseconds(duration);
+}
+
+inline void delay(uint32_t duration) {
+    HAL::backend()->delayMicroseconds(duration * 1000);
+}
+
+inline void noInterrupts() {}
+inline void interrupts() {}
+
+class String {
+public:
+    String() {}
+    String(const char *string) : value(string) {}
+    String(const std::string &string) : value(string) {}
+    String(char c) : value(1, c) {}
+    String(int number) : value(std::to_string(number)) {}
+    String(unsigned int number) : value(std::to_string(number)) {}
+    String(long number) : value(std::to_string(number)) {}
+    String(unsigned long number) : value(std::to_string(number)) {}
+    String(double number, int decimals = 2);
+
+    const char *c_str() const { return value.c_str(); }
+    unsigned int length() const { return value.length(); }
+
+    int indexOf(char c) const;
+    String substring(unsigned int from) const;
+    String substring(unsigned int from, unsigned int to) const;
+    long toInt() const;
+
+    String &operator+=(const String &other) {
+        value += other.value;
+        return *this;
+    }
+
+    friend String operator+(const String &a, const String &b) { return String(a.value + b.value); }
+    friend String operator+(const char *a, const String &b) { return String(a + b.value); }
+    friend String operator+(const String &a, const char *b) { return String(a.value + b); }
+
+    bool operator==(const String &other) const { return value == other.value; }
+
+private:
+    std::string value;
+};
+
+// Natively the callback runs between iterations of loop() instead of from an
+// interrupt, at most once per iteration
+class IntervalTimer {
+public:
+    IntervalTimer() {}
+    ~IntervalTimer() { end(); }
+
+    bool begin(void (*function)(), uint32_t microseconds);
+    void end();
+
+    static void update();
+
+private:
+    void (*callback)() = nullptr;
+    uint32_t period = 0;
+    uint32_t lastTime = 0;
+
+    static IntervalTimer *timers[HAL_NUM_TIMERS];
+};
+
+class HardwareSerial {
+public:
+    HardwareSerial(uint8_t serialPort) : port(serialPort) {}
+
+    void begin(uint32_t baud) { HAL::backend()->uartBegin(port, baud); }
+    void setTimeout(uint32_t timeout) {}
+
+    int available() { return HAL::backend()->uartAvailable(port); }
+    int read() { return HAL::backend()->uartRead(port); }
+    int peek() { return HAL::backend()->uartPeek(port); }
+    String readString();
+
+    size_t write(uint8_t data);
+    size_t write(const char *string);
+
+    size_t print(const String &string) { return write(string.c_str()); }
+    size_t print(const char *string) { return write(string); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int number) { return print(String(number)); }
+    size_t print(unsigned int number) { return print(String(number)); }
+    size_t print(long number) { return print(String(number)); }
+    size_t print(unsigned long number) { return print(String(number)); }
+    size_t print(double number, int decimals = 2) { return print(String(number, decimals)); }
+
+    size_t println() { return write("\r\n"); }
+
+    template <typename T>
+    size_t println(T value) {
+        size_t n = print(value);
+        return n + println();
+    }
+
+private:
+    uint8_t port;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+extern HardwareSerial Serial4;
+extern HardwareSerial Serial5;
+extern HardwareSerial Serial6;
+
+void setup();
+void loop();
+
+#endif // ARDUINO_H
@@ -0,0 +1,59 @@
+/* Native replacement for the Teensy EEPROM library, backed by memory.
+ */
+
+#ifndef EEPROM_H
+#define EEPROM_H
+
+#include "Arduino.h"
+
+#define E2END 0xFFF
+
+class EEPROMClass {
+public:
+    uint8_t read(int address) {
+        return address >= 0 && address <= E2END ? data[address] : 0;
+    }
+
+    void write(int address, uint8_t value) {
+        if (address >= 0 && address <= E2END) {
+            data[address] = value;
+        }
+    }
+
+    void update(int address, uint8_t value) {
+        write(address, value);
+    }
+
+    template <typename T>
+    T &get(int address, T &value) {
+        uint8_t *bytes = (uint8_t *)&value;
+
+        for (size_t i = 0; i < sizeof(T); i++) {
+            bytes[i] = read(address + i);
+        }
+
+        return value;
+    }
+
+    template <typename T>
+    const T &put(int address, const T &value) {
+        const uint8_t *bytes = (const uint8_t *)&value;
+
+        for (size_t i = 0; i < sizeof(T); i++) {
+            update(address + i, bytes[i]);
+        }
+
+        return value;
+    }
+
+    uint16_t length() {
+        return E2END + 1;
+    }
+
+private:
+    uint8_t data[E2END + 1] = {0};
+};
+
+extern EEPROMClass EEPROM;
+
+#endif // EEPROM_H
@@ -0,0 +1,92 @@
+#include "HAL.h"
+
+#include <chrono>
+#include <thread>
+#include <stdio.h>
+#include <string.h>
+
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+static HALBackend defaultBackend;
+static HALBackend *activeBackend = &defaultBackend;
+
+HALBackend::HALBackend() {
+    memset(pinValues, 0, sizeof(pinValues));
+    memset(analogValues, 0, sizeof(analogValues));
+}
+
+uint32_t HALBackend::micros() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void HALBackend::delayMicroseconds(uint32_t duration) {
+    std::this_thread::sleep_for(std::chrono::microseconds(duration));
+}
+
+void HALBackend::pinMode(uint8_t pin, uint8_t mode) {}
+
+uint8_t HALBackend::digitalRead(uint8_t pin) {
+    return pin < HAL_NUM_PINS ? pinValues[pin] : 0;
+}
+
+void HALBackend::digitalWrite(uint8_t pin, uint8_t value) {
+    if (pin < HAL_NUM_PINS) {
+        pinValues[pin] = value;
+    }
+}
+
+void HALBackend::analogWrite(uint8_t pin, int value) {
+    if (pin < HAL_NUM_PINS) {
+        analogValues[pin] = value;
+    }
+}
+
+int HALBackend::analogRead(uint8_t pin) {
+    return pin < HAL_NUM_PINS ? analogValues[pin] : 0;
+}
+
+uint16_t HALBackend::spiTransfer16(uint8_t cs, uint16_t data) {
+    // No slaves are attached
+    return 0;
+}
+
+uint8_t HALBackend::i2cWrite(uint8_t address, const uint8_t *data, uint8_t length) {
+    return 0;
+}
+
+uint8_t HALBackend::i2cRead(uint8_t address, uint8_t *data, uint8_t length) {
+    memset(data, 0, length);
+    return length;
+}
+
+uint32_t HALBackend::i2cRequest(uint8_t address, uint8_t *data, uint8_t length) {
+    i2cRead(address, data, length);
+    return micros();
+}
+
+void HALBackend::uartWrite(uint8_t port, uint8_t data) {
+    // USB serial goes to the terminal, the hardware serial ports go nowhere
+    if (port == 0) {
+        putchar(data);
+    }
+}
+
+int HALBackend::uartAvailable(uint8_t port) {
+    return 0;
+}
+
+int HALBackend::uartRead(uint8_t port) {
+    return -1;
+}
+
+int HALBackend::uartPeek(uint8_t port) {
+    return -1;
+}
+
+HALBackend *HAL::backend() {
+    return activeBackend;
+}
+
+void HAL::setBackend(HALBackend *newBackend) {
+    activeBackend = newBackend != nullptr ? newBackend : &defaultBackend;
+}
@@ -0,0 +1,75 @@
+/* Hardware abstraction layer for building the robot code natively on a PC.
+ *
+ * The Arduino, T3SPI, i2c_t3 and EEPROM headers in this library replace the
+ * Teensy ones in the native environment and forward every hardware access to
+ * the active HALBackend. The default backend is backed by Linux: the clock
+ * comes from steady_clock, pins and ADC channels are plain memory and
+ * Serial is printed to stdout. Other backends (e.g. a simulator) can be
+ * installed with HAL::setBackend.
+ */
+
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+
+#define HAL_NUM_PINS 128
+#define HAL_NUM_UARTS 7
+#define HAL_NUM_TIMERS 4
+
+class HALBackend {
+public:
+    HALBackend();
+    virtual ~HALBackend() {}
+
+    // Clock
+    virtual uint32_t micros();
+    virtual void delayMicroseconds(uint32_t duration);
+
+    // GPIO
+    virtual void pinMode(uint8_t pin, uint8_t mode);
+    virtual uint8_t digitalRead(uint8_t pin);
+    virtual void digitalWrite(uint8_t pin, uint8_t value);
+    virtual void analogWrite(uint8_t pin, int value);
+
+    // ADC
+    virtual int analogRead(uint8_t pin);
+
+    // SPI
+    virtual uint16_t spiTransfer16(uint8_t cs, uint16_t data);
+
+    // I2C
+    virtual void i2cBegin(uint32_t rate) {}
+    virtual uint8_t i2cWrite(uint8_t address, const uint8_t *data, uint8_t length);
+    virtual uint8_t i2cRead(uint8_t address, uint8_t *data, uint8_t length);
+
+    // Starts a read that carries on in the background and returns the micros()
+    // it will be finished at
+    virtual uint32_t i2cRequest(uint8_t address, uint8_t *data, uint8_t length);
+
+    // UART
+    virtual void uartBegin(uint8_t port, uint32_t baud) {}
+    virtual void uartWrite(uint8_t port, uint8_t data);
+    virtual int uartAvailable(uint8_t port);
+    virtual int uartRead(uint8_t port);
+    virtual int uartPeek(uint8_t port);
+
+    // Superloop
+    virtual bool running() { return true; }
+    virtual void loopComplete() {}
+
+    // The heading the IMU has worked out, so a simulator can compare it with the truth
+    virtual void headingUpdated(double heading) {}
+
+protected:
+    uint8_t pinValues[HAL_NUM_PINS];
+    int analogValues[HAL_NUM_PINS];
+};
+
+class HAL {
+public:
+    static HALBackend *backend();
+    static void setBackend(HALBackend *newBackend);
+};
+
+#endif // HAL_H
@@ -0,0 +1,3 @@
+#include "i2c_t3.h"
+
+i2c_t3 Wire;
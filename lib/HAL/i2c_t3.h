@@ -0,0 +1,138 @@
+/* Native replacement for the i2c_t3 library.
+ *
+ * Transmissions are buffered until endTransmission() and then forwarded to
+ * the active HALBackend, requests are read from it in one go. A request
+ * started with sendRequest() is read straight away but only counts as done
+ * once the backend's clock reaches the end of the transfer.
+ */
+
+#ifndef I2C_T3_H
+#define I2C_T3_H
+
+#include "Arduino.h"
+
+#define I2C_TX_BUFFER_LENGTH 259
+#define I2C_RX_BUFFER_LENGTH 259
+
+enum i2c_op_mode  {I2C_OP_MODE_IMM, I2C_OP_MODE_ISR, I2C_OP_MODE_DMA};
+enum i2c_mode     {I2C_MASTER, I2C_SLAVE};
+enum i2c_pullup   {I2C_PULLUP_EXT, I2C_PULLUP_INT};
+enum i2c_rate     {I2C_RATE_100  = 100000,
+                   I2C_RATE_200  = 200000,
+                   I2C_RATE_300  = 300000,
+                   I2C_RATE_400  = 400000,
+                   I2C_RATE_600  = 600000,
+                   I2C_RATE_800  = 800000,
+                   I2C_RATE_1000 = 1000000};
+enum i2c_stop     {I2C_NOSTOP, I2C_STOP};
+enum i2c_pins     {I2C_PINS_3_4,
+                   I2C_PINS_7_8,
+                   I2C_PINS_16_17,
+                   I2C_PINS_18_19,
+                   I2C_PINS_33_34,
+                   I2C_PINS_37_38,
+                   I2C_PINS_47_48};
+
+class i2c_t3 {
+public:
+    void begin(i2c_mode mode, uint8_t address, i2c_pins pins, i2c_pullup pullup, uint32_t rate, i2c_op_mode opMode = I2C_OP_MODE_ISR) {
+        HAL::backend()->i2cBegin(rate);
+    }
+
+    void setDefaultTimeout(uint32_t timeout) {}
+
+    void beginTransmission(uint8_t address) {
+        txAddress = address;
+        txLength = 0;
+    }
+
+    size_t write(uint8_t data) {
+        if (txLength < I2C_TX_BUFFER_LENGTH) {
+            txBuffer[txLength++] = data;
+            return 1;
+        }
+
+        return 0;
+    }
+
+    size_t write(const uint8_t *data, size_t length) {
+        size_t n = 0;
+
+        while (n < length && write(data[n])) {
+            n++;
+        }
+
+        return n;
+    }
+
+    uint8_t endTransmission(i2c_stop sendStop = I2C_STOP) {
+        return HAL::backend()->i2cWrite(txAddress, txBuffer, txLength);
+    }
+
+    size_t requestFrom(uint8_t address, size_t length, i2c_stop sendStop) {
+        if (length > I2C_RX_BUFFER_LENGTH) {
+            length = I2C_RX_BUFFER_LENGTH;
+        }
+
+        rxIndex = 0;
+        rxLength = HAL::backend()->i2cRead(address, rxBuffer, length);
+
+        return rxLength;
+    }
+
+    size_t requestFrom(int address, int length) {
+        return requestFrom((uint8_t)address, (size_t)length, I2C_STOP);
+    }
+
+    void sendRequest(uint8_t address, size_t length, i2c_stop sendStop) {
+        if (length > I2C_RX_BUFFER_LENGTH) {
+            length = I2C_RX_BUFFER_LENGTH;
+        }
+
+        rxIndex = 0;
+        rxLength = length;
+        requestEnd = HAL::backend()->i2cRequest(address, rxBuffer, length);
+        requesting = true;
+    }
+
+    uint8_t done() {
+        return !requesting || (int32_t)(micros() - requestEnd) >= 0;
+    }
+
+    uint8_t finish() {
+        if (!done()) {
+            delayMicroseconds(requestEnd - micros());
+        }
+
+        requesting = false;
+        return 1;
+    }
+
+    int available() {
+        return rxLength - rxIndex;
+    }
+
+    int read() {
+        return rxIndex < rxLength ? rxBuffer[rxIndex++] : -1;
+    }
+
+    int peek() {
+        return rxIndex < rxLength ? rxBuffer[rxIndex] : -1;
+    }
+
+private:
+    uint8_t txAddress = 0;
+    uint8_t txBuffer[I2C_TX_BUFFER_LENGTH];
+    size_t txLength = 0;
+
+    uint8_t rxBuffer[I2C_RX_BUFFER_LENGTH];
+    size_t rxLength = 0;
+    size_t rxIndex = 0;
+
+    bool requesting = false;
+    uint32_t requestEnd = 0;
+};
+
+extern i2c_t3 Wire;
+
+#endif // I2C_T3_H
@@ -0,0 +1,106 @@
+/* Native replacement for the T3SPI library.
+ *
+ * Master transfers are forwarded one frame at a time to the active
+ * HALBackend. In slave mode there is no bus, so nothing is received.
+ */
+
+#ifndef _t3spi_h
+#define _t3spi_h
+
+#include "Arduino.h"
+
+#define maxDataLength		256
+
+#define MASTER				1
+#define SLAVE				0
+
+#define SPI_CLOCK_DIV2		0b0000	//24.0	MHz
+#define SPI_CLOCK_DIV4		0b0001	//12.0	MHz
+#define SPI_CLOCK_DIV6		0b0010	//08.0	MHz
+#define SPI_CLOCK_DIV8		0b0011	//05.3	MHz
+#define SPI_CLOCK_DIV16		0b0100	//03.0	MHz
+#define SPI_CLOCK_DIV32		0b0101	//01.5	MHz
+#define SPI_CLOCK_DIV64		0b0110	//750	KHz
+#define SPI_CLOCK_DIV128	0b0111	//375	Khz
+
+#define SPI_MODE0			0x00
+#define SPI_MODE1			0x01
+#define SPI_MODE2			0x02
+#define SPI_MODE3			0x03
+
+#define MSB_FIRST			0
+#define LSB_FIRST			1
+
+#define CTAR_0				0
+#define CTAR_1				1
+#define CTAR_SLAVE			2
+
+#define	SCK					0x0D
+#define MOSI				0x0B
+#define MISO				0x0C
+#define ALT_SCK				0x0E
+#define ALT_MOSI			0x07
+#define ALT_MISO			0x08
+
+#define CS0					0x01
+#define CS1					0x02
+#define CS2					0x04
+#define CS3					0x08
+#define CS4					0x10
+#define ALT_CS0				0x81
+#define ALT_CS1				0x82
+#define ALT_CS2				0x84
+#define ALT_CS3				0x88
+
+#define CS_ActiveLOW		1
+#define CS_ActiveHIGH		0
+
+class T3SPI {
+public:
+	volatile int dataPointer = 0;
+	volatile int packetCT = 0;
+
+	T3SPI() {}
+
+	//Functions for MASTER MODE
+	static void begin_MASTER() {}
+	void begin_MASTER(uint8_t sck, uint8_t mosi, uint8_t miso, uint8_t cs, bool activeState) {}
+	static void setCTAR(bool CTARn, uint8_t size, uint8_t dataMode, uint8_t bo, uint8_t cdiv) {}
+	static void enableCS(uint8_t cs, bool activeState) {}
+
+	void tx16(volatile uint16_t *dataOUT, int length, bool CTARn, uint8_t PCS) {
+		for (int i = 0; i < length; i++) {
+			HAL::backend()->spiTransfer16(PCS, dataOUT[i]);
+		}
+	}
+
+	void txrx16(volatile uint16_t *dataOUT, volatile uint16_t *dataIN, int length, bool CTARn, uint8_t PCS) {
+		for (int i = 0; i < length; i++) {
+			dataIN[i] = HAL::backend()->spiTransfer16(PCS, dataOUT[i]);
+		}
+	}
+
+	//Functions for SLAVE MODE
+	static void begin_SLAVE() {}
+	static void begin_SLAVE(uint8_t sck, uint8_t mosi, uint8_t miso, uint8_t cs) {}
+	static void setCTAR_SLAVE(uint8_t size, uint8_t dataMode) {}
+
+	void rx16(volatile uint16_t *dataIN, int length) {
+		for (int i = 0; i < length; i++) {
+			dataIN[i] = 0;
+		}
+	}
+
+	void rxtx16(volatile uint16_t *dataIN, volatile uint16_t *dataOUT, int length) {
+		rx16(dataIN, length);
+	}
+
+	//Global Functions
+	static void start() {}
+	static void stop() {}
+	static void end() {}
+};
+
+extern T3SPI spi;
+
+#endif /* _t3spi_h */
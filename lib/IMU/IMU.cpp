@@ -2,15 +2,78 @@
 
 void IMU::init() {
     I2CwriteByte(MPU9250_ADDRESS, 29, 0x06);
-    I2CwriteByte(MPU9250_ADDRESS, 26, 0x06);
+
+    #if IMU_FIFO
+        // 92 Hz gyro low pass at 1 kHz, every sample is integrated so the 5 Hz
+        // filter (and its 33 ms delay) isn't needed
+        I2CwriteByte(MPU9250_ADDRESS, 26, 0x02);
+        I2CwriteByte(MPU9250_ADDRESS, 25, IMU_SAMPLE_TIME / 1000 - 1);
+    #else
+        I2CwriteByte(MPU9250_ADDRESS, 26, 0x06);
+    #endif
     I2CwriteByte(MPU9250_ADDRESS, 27, GYRO_FULL_SCALE_1000_DPS);
     I2CwriteByte(MPU9250_ADDRESS, 28, ACC_FULL_SCALE_2_G);
     I2CwriteByte(MPU9250_ADDRESS, 0x37, 0x02);
     I2CwriteByte(MAG_ADDRESS, 0x0A, 0x16);
 
+    #if IMU_FIFO
+        // Only gyro Z goes into the FIFO
+        I2CwriteByte(MPU9250_ADDRESS, 0x23, 0x10);
+        resetFIFO();
+    #endif
+
+    loadMagCalibration();
+
     previousTimeGyro = micros();
+    gyroSampleTime = previousTimeGyro;
 };
 
+void IMU::resetFIFO() {
+    // Enable and empty the FIFO
+    I2CwriteByte(MPU9250_ADDRESS, 0x6A, 0x44);
+}
+
+void IMU::integrate(double reading, double time) {
+    trackBias(reading);
+
+    gyroRate = -(reading - calibrationGyro);
+    gyroHeading += time * gyroRate;
+}
+
+void IMU::trackBias(double reading) {
+    if (!motorsIdle) {
+        biasCount = 0;
+        biasSum = 0;
+        biasSquares = 0;
+        biasPreviousValid = false;
+        return;
+    }
+
+    biasSum += reading;
+    biasSquares += reading * reading;
+    biasCount++;
+
+    if (biasCount == IMU_BIAS_WINDOW) {
+        double mean = biasSum / IMU_BIAS_WINDOW;
+        double variance = biasSquares / IMU_BIAS_WINDOW - mean * mean;
+
+        // A noisy window means the robot is being moved, a change from the
+        // last window means it is still coasting to a stop and more than any
+        // bias could be means it is being turned
+        if (variance < IMU_BIAS_MAX_VARIANCE && biasPreviousValid && fabs(mean - biasPreviousMean) < IMU_BIAS_MAX_CHANGE && fabs(mean) < IMU_BIAS_MAX) {
+            calibrationGyro = biasKnown ? calibrationGyro + IMU_BIAS_GAIN * (mean - calibrationGyro) : mean;
+            biasKnown = true;
+        }
+
+        biasPreviousMean = mean;
+        biasPreviousValid = true;
+
+        biasCount = 0;
+        biasSum = 0;
+        biasSquares = 0;
+    }
+}
+
 Vector3D IMU::readAccelerometer() {
     uint8_t buffer[14];
     I2Cread(MPU9250_ADDRESS, 0x3B, 14, buffer);
@@ -36,38 +99,222 @@ Vector3D IMU::readGyroscope() {
 }
 
 Vector3D IMU::readMagnetometer() {
-    uint8_t status1;
-    do {
-        I2Cread(MAG_ADDRESS, 0x02, 1, &status1);
-    } while (!(status1 & 0x01));
-
-    uint8_t mag[7];
-    I2Cread(MAG_ADDRESS, 0x03, 7, mag);
-
-    int16_t mx = -(mag[3] << 8 | mag[2]);
-    int16_t my = -(mag[1] << 8 | mag[0]);
-    int16_t mz = -(mag[5] << 8 | mag[4]);
+    // The latest reading, without waiting for a new one
+    int16_t mx, my, mz;
+    readMagnetometerRaw(mx, my, mz);
 
     Vector3D returnVector = {(double) mx, (double) my, (double) mz};
     return returnVector;
 }
 
+bool IMU::readMagnetometerRaw(int16_t &mx, int16_t &my, int16_t &mz) {
+    // ST1, the data and ST2 in one go. Reading ST2 lets the AK8963 take the next reading
+    uint8_t mag[8];
+    I2Cread(MAG_ADDRESS, 0x02, 8, mag);
+
+    mx = -(mag[4] << 8 | mag[3]);
+    my = -(mag[2] << 8 | mag[1]);
+    mz = -(mag[6] << 8 | mag[5]);
+
+    // Data ready and no magnetic overflow
+    return (mag[0] & 0x01) && !(mag[7] & 0x08);
+}
+
+bool IMU::updateMagnetometer() {
+    // Returns whether there was a new reading
+    int16_t mx, my, mz;
+
+    if (!readMagnetometerRaw(mx, my, mz)) {
+        return false;
+    }
+
+    if (magCalibrating) {
+        magMinX = min(magMinX, mx);
+        magMaxX = max(magMaxX, mx);
+        magMinY = min(magMinY, my);
+        magMaxY = max(magMaxY, my);
+
+        return true;
+    }
+
+    if (!magCalibrated) {
+        return true;
+    }
+
+    double x = (mx - magOffsetX) * magScaleX;
+    double y = (my - magOffsetY) * magScaleY;
+
+    // Turning clockwise turns the field anticlockwise relative to the robot
+    double magHeading = radiansToDegrees(atan2(y, x));
+
+    if (!magReferenced) {
+        magReference = magHeading - gyroHeading;
+        magReferenced = true;
+    }
+
+    // Complementary filter, the gyro is trusted in the short term and the magnetometer in the long term
+    double difference = doubleMod(magHeading - magReference - gyroHeading + 540, 360) - 180;
+    gyroHeading = doubleMod(gyroHeading + IMU_MAG_WEIGHT * difference, 360);
+
+    return true;
+}
+
+void IMU::loadMagCalibration() {
+    MagCalibration calibration;
+    EEPROM.get(IMU_MAG_CALIBRATION_EEPROM, calibration);
+
+    // Without a stored calibration the heading is from the gyro alone
+    magCalibrated = calibration.key == IMU_MAG_CALIBRATION_KEY;
+
+    if (magCalibrated) {
+        magOffsetX = calibration.offsetX;
+        magOffsetY = calibration.offsetY;
+        magScaleX = calibration.scaleX;
+        magScaleY = calibration.scaleY;
+    }
+
+    magReferenced = false;
+}
+
+void IMU::startMagCalibration() {
+    magMinX = INT16_MAX;
+    magMaxX = INT16_MIN;
+    magMinY = INT16_MAX;
+    magMaxY = INT16_MIN;
+
+    magCalibrating = true;
+}
+
+void IMU::cancelMagCalibration() {
+    // Partial turns only trace part of the ellipse, so leave the old offsets
+    magCalibrating = false;
+}
+
+bool IMU::finishMagCalibration() {
+    /* Over whole turns the field traces an ellipse. Its centre is the hard
+     * iron offset and scaling each axis to the same radius corrects the soft
+     * iron (only along the axes)
+     */
+    magCalibrating = false;
+
+    double radiusX = (magMaxX - magMinX) / 2.0;
+    double radiusY = (magMaxY - magMinY) / 2.0;
+
+    if (radiusX < IMU_MAG_MIN_RANGE || radiusY < IMU_MAG_MIN_RANGE) {
+        return false;
+    }
+
+    MagCalibration calibration;
+    calibration.key = IMU_MAG_CALIBRATION_KEY;
+    calibration.offsetX = (magMaxX + magMinX) / 2.0;
+    calibration.offsetY = (magMaxY + magMinY) / 2.0;
+    calibration.scaleX = (radiusX + radiusY) / 2.0 / radiusX;
+    calibration.scaleY = (radiusX + radiusY) / 2.0 / radiusY;
+
+    EEPROM.put(IMU_MAG_CALIBRATION_EEPROM, calibration);
+    loadMagCalibration();
+
+    return true;
+}
+
+void IMU::requestGyroscope() {
+    // Read in the background while the loop carries on
+    Wire.beginTransmission(MPU9250_ADDRESS);
+
+    #if IMU_FIFO
+        // The FIFO count and then that many bytes of samples, on alternate loops
+        Wire.write(fifoReadLength > 0 ? MPU9250_FIFO_DATA : MPU9250_FIFO_COUNT);
+        Wire.endTransmission(I2C_NOSTOP);
+
+        Wire.sendRequest(MPU9250_ADDRESS, fifoReadLength > 0 ? fifoReadLength : 2, I2C_STOP);
+    #else
+        // Only the two gyro Z bytes
+        Wire.write(MPU9250_GYRO_Z);
+        Wire.endTransmission(I2C_NOSTOP);
+
+        Wire.sendRequest(MPU9250_ADDRESS, 2, I2C_STOP);
+    #endif
+
+    gyroRequested = true;
+    gyroRequestTime = micros();
+}
+
 void IMU::update() {
-    double reading = (double)readGyroscope().z;
+    // Collect the read from requestGyroscope(), or read now if there isn't one
+    if (!gyroRequested) {
+        requestGyroscope();
+    }
+
+    Wire.finish();
+    gyroRequested = false;
+
+    #if IMU_FIFO
+        if (fifoReadLength > 0) {
+            // The FIFO keeps every sample between reads, so none are missed
+            for (int i = 0; i < fifoReadLength; i += 2) {
+                int16_t gz = Wire.read() << 8;
+                gz |= Wire.read();
+
+                integrate(convertRawGyro(gz), IMU_SAMPLE_TIME / 1000000.0);
+            }
+
+            gyroSampleTime = fifoSampleTime;
+            fifoReadLength = 0;
+        } else {
+            int count = Wire.read() << 8;
+            count |= Wire.read();
 
-	long currentTime = micros();
-    heading += -(((double)(currentTime - previousTimeGyro) / 1000000.0) * (reading - calibrationGyro));
-	heading = doubleMod(heading, 360.0);
+            if (count >= MPU9250_FIFO_SIZE) {
+                // Samples have been overwritten so the FIFO can't be trusted
+                resetFIFO();
+                count = 0;
+            }
 
-	previousTimeGyro = currentTime;
+            // Whole samples only, the rest are left for next time
+            fifoReadLength = min(count & ~1, IMU_FIFO_BURST);
+            fifoSampleTime = gyroRequestTime - ((count & ~1) - fifoReadLength) / 2 * IMU_SAMPLE_TIME;
+        }
+    #else
+        int16_t gz = Wire.read() << 8;
+        gz |= Wire.read();
+
+        // The reading is from when it was requested
+        long currentTime = gyroRequestTime;
+        integrate(convertRawGyro(gz), (double)(currentTime - previousTimeGyro) / 1000000.0);
+
+        previousTimeGyro = currentTime;
+        gyroSampleTime = currentTime;
+    #endif
+
+	gyroHeading = doubleMod(gyroHeading, 360.0);
+
+    #if IMU_MAG_FUSION
+        // The AK8963 only has a new reading every IMU_MAG_UPDATE_TIME
+        if (magTimer.timeHasPassed()) {
+            updateMagnetometer();
+        }
+    #endif
+
+    heading = doubleMod(gyroHeading + gyroRate * (long)(micros() - gyroSampleTime) / 1000000.0, 360.0);
+
+    #ifdef NATIVE
+        HAL::backend()->headingUpdated(heading);
+    #endif
 }
 
 void IMU::calibrate() {
-    for (int i = 0; i < IMU_CALIBRATION_COUNT; i++) {
-        double readingGyro = (double)readGyroscope().z;
-        calibrationGyro += readingGyro;
-        delay(IMU_CALIBRATION_TIME);
+    // Wait for the first still windows, the bias carries on being tracked from then on
+    motorsIdle = true;
+
+    unsigned long startTime = millis();
+
+    while (!biasKnown && millis() - startTime < IMU_CALIBRATION_TIMEOUT) {
+        update();
     }
 
-    calibrationGyro /= IMU_CALIBRATION_COUNT;
+    motorsIdle = false;
+
+    heading = 0;
+    gyroHeading = 0;
+    magReferenced = false;
 }
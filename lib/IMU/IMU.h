@@ -4,11 +4,25 @@
 #include <I2C.h>
 #include <Common.h>
 #include <Config.h>
+#include <Timer.h>
+#include <EEPROM.h>
+
+// How the magnetometer calibration is stored in EEPROM
+typedef struct MagCalibration {
+    uint16_t key;
+    float offsetX;
+    float offsetY;
+    float scaleX;
+    float scaleY;
+} MagCalibration;
 
 class IMU {
 public:
     double heading;
 
+    // Set while the motors are stopped, the gyro bias is only learnt then
+    bool motorsIdle = false;
+
     IMU() {};
     void init();
 
@@ -16,12 +30,64 @@ public:
     Vector3D readGyroscope();
     Vector3D readMagnetometer();
 
+    void requestGyroscope();
     void update();
     void calibrate();
 
+    bool updateMagnetometer();
+    void loadMagCalibration();
+    void startMagCalibration();
+    bool finishMagCalibration();
+    void cancelMagCalibration();
+
 private:
     long previousTimeGyro;
-    double calibrationGyro;
+    double calibrationGyro = 0;
+
+    // Gyro read started by requestGyroscope() and collected by update()
+    bool gyroRequested = false;
+    long gyroRequestTime;
+
+    // Bytes of samples the next FIFO read collects, 0 when it reads the count
+    int fifoReadLength = 0;
+
+    // When the newest sample the next FIFO read collects was taken
+    long fifoSampleTime;
+
+    // The reads finish a loop or two after the samples were taken, so heading
+    // is gyroHeading carried on from the newest sample at its turn rate
+    double gyroHeading = 0;
+    double gyroRate = 0;
+    long gyroSampleTime;
+
+    void resetFIFO();
+    void integrate(double reading, double time);
+
+    // Current bias window
+    void trackBias(double reading);
+    bool biasKnown = false;
+    int biasCount = 0;
+    double biasSum = 0;
+    double biasSquares = 0;
+    bool biasPreviousValid = false;
+    double biasPreviousMean = 0;
+
+    // Magnetometer, x and y are in the same frame as the gyro
+    Timer magTimer = Timer(IMU_MAG_UPDATE_TIME);
+    bool readMagnetometerRaw(int16_t &mx, int16_t &my, int16_t &mz);
+
+    bool magCalibrated = false;
+    double magOffsetX = 0;
+    double magOffsetY = 0;
+    double magScaleX = 1;
+    double magScaleY = 1;
+
+    bool magCalibrating = false;
+    int16_t magMinX, magMaxX, magMinY, magMaxY;
+
+    // Magnetic heading when the gyro heading was 0
+    bool magReferenced = false;
+    double magReference = 0;
 
     double convertRawAcceleration(int raw) {
         // Since we are using 2G range
@@ -16,6 +16,12 @@ void LightSensor::init() {
     }
 
     thresholdValue = round((int)((double)defaultValue / LS_CALIBRATION_COUNT) + LS_CALIBRATION_BUFFER);
+
+    #if LS_ADAPTIVE_THRESHOLDS
+        // Halfway between the levels starts out as the calibrated threshold
+        greenLevel = (defaultValue << 4) / LS_CALIBRATION_COUNT;
+        whiteLevel = greenLevel + (LS_MIN_CONTRAST << 4);
+    #endif
 }
 
 void LightSensor::read() {
@@ -24,9 +30,60 @@ void LightSensor::read() {
 
 bool LightSensor::isOnWhite() {
     read();
-    return (value > thresholdValue);
+    return isOnWhite(value);
+}
+
+// For a reading taken elsewhere, e.g. by the scanner
+bool LightSensor::isOnWhite(int reading) {
+    value = reading;
+
+    #if LS_ADAPTIVE_THRESHOLDS
+        int level = value << 4;
+        int threshold = (greenLevel + whiteLevel) / 2;
+        int hysteresis = (whiteLevel - greenLevel) / LS_HYSTERESIS_DIVISOR;
+
+        onWhite = onWhite ? level > threshold - hysteresis : level > threshold + hysteresis;
+
+        return onWhite;
+    #else
+        return (value > thresholdValue);
+    #endif
+}
+
+// Move the level the last reading was classified as towards it
+void LightSensor::updateLevels() {
+    #if LS_ADAPTIVE_THRESHOLDS
+        int level = value << 4;
+        int threshold = (greenLevel + whiteLevel) / 2;
+        int hysteresis = (whiteLevel - greenLevel) / LS_HYSTERESIS_DIVISOR;
+
+        // Readings within the hysteresis could be either, so they move neither
+        // level. Green never follows white, so a sensor parked over a line keeps
+        // seeing it
+        if (onWhite && level > threshold + hysteresis) {
+            whiteLevel += (level - whiteLevel) >> LS_LEVEL_SHIFT;
+        } else if (!onWhite && level < threshold - hysteresis) {
+            greenLevel += (level - greenLevel) >> LS_LEVEL_SHIFT;
+        }
+
+        whiteLevel = max(whiteLevel, greenLevel + (LS_MIN_CONTRAST << 4));
+    #endif
 }
 
 int LightSensor::getValue() {
     return value;
 }
+
+// How far the last reading is from green to white in sixteenths, roughly how
+// much of what the sensor sees is white
+int LightSensor::getWhiteness() {
+    #if LS_ADAPTIVE_THRESHOLDS
+        int green = greenLevel;
+        int white = whiteLevel;
+    #else
+        int green = (thresholdValue - LS_CALIBRATION_BUFFER) << 4;
+        int white = (thresholdValue + LS_CALIBRATION_BUFFER) << 4;
+    #endif
+
+    return constrain(((value << 4) - green) * 16 / (white - green), 0, 16);
+}
@@ -12,12 +12,22 @@ public:
 
     void read();
     bool isOnWhite();
+    bool isOnWhite(int reading);
+    void updateLevels();
     int getValue();
+    int getWhiteness();
 
 private:
     int value;
     int inPin;
     int thresholdValue;
+
+    #if LS_ADAPTIVE_THRESHOLDS
+        // In sixteenths of a reading
+        int greenLevel;
+        int whiteLevel;
+        bool onWhite = false;
+    #endif
 };
 
 #endif // LIGHT_SENSOR_H
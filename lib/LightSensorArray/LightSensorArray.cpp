@@ -4,157 +4,356 @@ LightSensorArray::LightSensorArray() {
     for (int i = 0; i < LS_NUM; i++) {
         sensors[i] = LightSensor(lsPins[i]);
     }
+
+    #if LS_LINE_TABLE
+        for (int i = 0; i < 360; i++) {
+            lineSizes[i] = (uint8_t)round((1 - cos(degreesToRadians(i / 2.0))) * 100);
+        }
+    #endif
 }
 
 void LightSensorArray::init() {
     for (int i = 0; i < LS_NUM; i++) {
         sensors[i].init();
     }
+
+    // analogRead can't be used once the ADCs are scanning
+    #if LS_SCANNED
+        scanner.begin(lsPins, LS_NUM);
+    #endif
 }
 
-void LightSensorArray::read() {
-    for (int i = 0; i < LS_NUM; i++) {
-        data[i] = sensors[i].isOnWhite();
+#if LS_BITMASK_CLUSTERS
+    // Sensor i moves to i + 1 and i - 1 around the ring
+    static inline uint32_t rotateClockwise(uint32_t mask) {
+        return ((mask << 1) | (mask >> (LS_NUM - 1))) & LS_MASK;
+    }
+
+    static inline uint32_t rotateCounterClockwise(uint32_t mask) {
+        return ((mask >> 1) | (mask << (LS_NUM - 1))) & LS_MASK;
+    }
+#endif
+
+#if LS_LINE_TABLE
+    // Positions are in sixteenths of a sensor clockwise from sensor 0. Whole
+    // degrees clockwise from one to another and to halfway, both truncated
+    // like angleBetween and midAngleBetween
+    static int angleBetweenCentres(int from, int to) {
+        return mod(360 * (to - from) / (LS_NUM * 16), 360);
+    }
+
+    static int midAngleOfCentres(int from, int to) {
+        return mod((360 * from + angleBetweenCentres(from, to) * LS_NUM * 8) / (LS_NUM * 16), 360);
     }
+#endif
+
+bool LightSensorArray::frameReady() {
+    #if LS_SCANNED
+        return scanner.frameReady();
+    #else
+        return true;
+    #endif
+}
+
+void LightSensorArray::read() {
+    dataMask = 0;
+
+    #if LS_SCANNED
+        uint16_t values[LS_NUM];
+        scanner.read(values);
+
+        for (int i = 0; i < LS_NUM; i++) {
+            data[i] = sensors[i].isOnWhite(values[i]);
+            dataMask |= (uint32_t)data[i] << i;
+        }
+    #else
+        for (int i = 0; i < LS_NUM; i++) {
+            data[i] = sensors[i].isOnWhite();
+            dataMask |= (uint32_t)data[i] << i;
+        }
+    #endif
+
+    #if LS_ADAPTIVE_THRESHOLDS
+        if (levelTimer.timeHasPassed()) {
+            for (int i = 0; i < LS_NUM; i++) {
+                sensors[i].updateLevels();
+            }
+        }
+    #endif
 }
 
 void LightSensorArray::calculateClusters(bool doneFillInSensors) {
-    bool *lightData = !doneFillInSensors ? data : filledInData;
+    #if LS_BITMASK_CLUSTERS
+        /* The same clusters as the scan below. Runs are found from sensor 0 to
+         * 23 and the last joins the first if they meet across 0. A fourth run
+         * is dropped (or joined) if it reaches 23, any other fourth run means
+         * filling in single sensor gaps and then no line
+         */
+        uint32_t mask = !doneFillInSensors ? dataMask : filledInMask;
 
-    resetClusters();
+        uint32_t starts = mask & ~(mask << 1);
+        uint32_t ends = mask & ~(mask >> 1);
 
-    bool cluster1Done = false;
-    bool cluster2Done = false;
-    bool cluster3Done = false;
+        int lefts[4];
+        int rights[4];
+        int runs = 0;
 
-    LightSensorCluster cluster4 = LightSensorCluster(0.0, 0);
+        while (starts != 0 && runs < 4) {
+            lefts[runs] = __builtin_ctz(starts);
+            rights[runs] = __builtin_ctz(ends);
+            starts &= starts - 1;
+            ends &= ends - 1;
+            runs++;
+        }
 
-    for (int i = 0; i < LS_NUM; i++) {
-        if (cluster1Done) {
-            if (cluster2Done) {
-                if (cluster3Done) {
-                    if (lightData[i]) {
-                        if (cluster4.getLength() == 0) {
-                            cluster4 = LightSensorCluster((double)i, 1);
+        bool reachesEnd = (mask >> (LS_NUM - 1)) & 1;
+
+        if (starts != 0 || (runs == 4 && !reachesEnd)) {
+            resetClusters();
+            numClusters = 0;
+
+            if (!doneFillInSensors) {
+                fillInSensors();
+            }
+
+            return;
+        }
+
+        if (runs >= 2 && lefts[0] == 0 && reachesEnd) {
+            lefts[0] = lefts[runs - 1];
+            runs--;
+        } else if (runs == 4) {
+            runs--;
+        }
+
+        LightSensorCluster *clusters[3] = {&cluster1, &cluster2, &cluster3};
+
+        for (int i = 0; i < 3; i++) {
+            *clusters[i] = i < runs ? LightSensorCluster(lefts[i], rights[i]) : LightSensorCluster(0.0, 0);
+        }
+
+        numClusters = runs;
+    #else
+        bool *lightData = !doneFillInSensors ? data : filledInData;
+
+        resetClusters();
+
+        bool cluster1Done = false;
+        bool cluster2Done = false;
+        bool cluster3Done = false;
+
+        LightSensorCluster cluster4 = LightSensorCluster(0.0, 0);
+
+        for (int i = 0; i < LS_NUM; i++) {
+            if (cluster1Done) {
+                if (cluster2Done) {
+                    if (cluster3Done) {
+                        if (lightData[i]) {
+                            if (cluster4.getLength() == 0) {
+                                cluster4 = LightSensorCluster((double)i, 1);
+                            } else {
+                                cluster4.addSensorClockwise();
+                            }
+
+                            if (i == 23 && cluster1.getLeftSensor() == 0) {
+                                cluster1.addCluster(cluster4);
+                                cluster4 = LightSensorCluster(0.0, 0);
+                            }
                         } else {
-                            cluster4.addSensorClockwise();
-                        }
+                            if (cluster4.getLength() != 0) {
+                                if (!doneFillInSensors) {
+                                    fillInSensors();
+                                } else {
+                                    resetClusters();
+                                }
 
-                        if (i == 23 && cluster1.getLeftSensor() == 0) {
-                            cluster1.addCluster(cluster4);
-                            cluster4 = LightSensorCluster(0.0, 0);
+                                break;
+                            }
                         }
                     } else {
-                        if (cluster4.getLength() != 0) {
-                            if (!doneFillInSensors) {
-                                fillInSensors();
+                        if (lightData[i]) {
+                            if (cluster3.getLength() == 0) {
+                                cluster3 = LightSensorCluster((double)i, 1);
                             } else {
-                                resetClusters();
+                                cluster3.addSensorClockwise();
                             }
 
-                            break;
+                            if (i == 23 && cluster1.getLeftSensor() == 0) {
+                                cluster1.addCluster(cluster3);
+                                cluster3 = LightSensorCluster(0.0, 0);
+                            }
+                        } else {
+                            if (cluster3.getLength() != 0) {
+                                cluster3Done = true;
+                            }
                         }
                     }
                 } else {
                     if (lightData[i]) {
-                        if (cluster3.getLength() == 0) {
-                            cluster3 = LightSensorCluster((double)i, 1);
+                        if (cluster2.getLength() == 0) {
+                            cluster2 = LightSensorCluster((double)i, 1);
                         } else {
-                            cluster3.addSensorClockwise();
+                            cluster2.addSensorClockwise();
                         }
 
                         if (i == 23 && cluster1.getLeftSensor() == 0) {
-                            cluster1.addCluster(cluster3);
-                            cluster3 = LightSensorCluster(0.0, 0);
+                            cluster1.addCluster(cluster2);
+                            cluster2 = LightSensorCluster(0.0, 0);
                         }
                     } else {
-                        if (cluster3.getLength() != 0) {
-                            cluster3Done = true;
+                        if (cluster2.getLength() != 0) {
+                            cluster2Done = true;
                         }
                     }
                 }
             } else {
                 if (lightData[i]) {
-                    if (cluster2.getLength() == 0) {
-                        cluster2 = LightSensorCluster((double)i, 1);
+                    if (cluster1.getLength() == 0) {
+                        cluster1 = LightSensorCluster((double)i, 1);
                     } else {
-                        cluster2.addSensorClockwise();
-                    }
-
-                    if (i == 23 && cluster1.getLeftSensor() == 0) {
-                        cluster1.addCluster(cluster2);
-                        cluster2 = LightSensorCluster(0.0, 0);
+                        cluster1.addSensorClockwise();
                     }
                 } else {
-                    if (cluster2.getLength() != 0) {
-                        cluster2Done = true;
+                    if (cluster1.getLength() != 0) {
+                        cluster1Done = true;
                     }
                 }
             }
-        } else {
-            if (lightData[i]) {
-                if (cluster1.getLength() == 0) {
-                    cluster1 = LightSensorCluster((double)i, 1);
-                } else {
-                    cluster1.addSensorClockwise();
-                }
-            } else {
-                if (cluster1.getLength() != 0) {
-                    cluster1Done = true;
-                }
-            }
         }
-    }
 
-    numClusters = (int)(cluster1.getLength() != 0) + (int)(cluster2.getLength() != 0) + (int)(cluster3.getLength() != 0);
+        numClusters = (int)(cluster1.getLength() != 0) + (int)(cluster2.getLength() != 0) + (int)(cluster3.getLength() != 0);
+    #endif
 }
 
 void LightSensorArray::fillInSensors() {
-    for (int i = 0; i < LS_NUM; i++) {
-        filledInData[i] = data[i];
+    #if LS_BITMASK_CLUSTERS
+        // A sensor is filled in if both its neighbours are on white
+        filledInMask = dataMask | (rotateClockwise(dataMask) & rotateCounterClockwise(dataMask));
+    #else
+        for (int i = 0; i < LS_NUM; i++) {
+            filledInData[i] = data[i];
 
-        if (!data[i] && data[mod(i - 1, LS_NUM)] && data[mod(i + 1, LS_NUM)]) {
-            filledInData[i] = true;
+            if (!data[i] && data[mod(i - 1, LS_NUM)] && data[mod(i + 1, LS_NUM)]) {
+                filledInData[i] = true;
+            }
         }
-    }
+    #endif
 
     calculateClusters(true);
 }
 
+#if LS_LINE_TABLE
+    // The centre of a cluster and the angle it covers in sixteenths of a sensor
+    void LightSensorArray::clusterEdges(LightSensorCluster &cluster, int &centre, int &width) {
+        int left = cluster.getLeftSensor();
+        int right = cluster.getRightSensor();
+
+        int leftEdge = left * 16;
+        width = mod(right - left, LS_NUM) * 16;
+
+        #if LS_ANALOG_EDGES
+            /* An edge is half a sensor out from a fully white boundary sensor,
+             * less how much of that sensor isn't white and plus how much of the
+             * next sensor out is white
+             */
+            int leftWhiteness = sensors[left].getWhiteness() + sensors[mod(left - 1, LS_NUM)].getWhiteness();
+            int rightWhiteness = sensors[right].getWhiteness() + sensors[mod(right + 1, LS_NUM)].getWhiteness();
+
+            leftEdge += 8 - leftWhiteness;
+            width += leftWhiteness + rightWhiteness - 16;
+        #endif
+
+        centre = mod(leftEdge + width / 2, LS_NUM * 16);
+        width = constrain(width, 0, LS_NUM * 16 - 1);
+    }
+#endif
+
 void LightSensorArray::calculateLine() {
-    if (numClusters == 0) {
-        angle = NO_LINE_ANGLE;
-        size = NO_LINE_SIZE;
-    } else {
-        double cluster1Angle = cluster1.getAngle();
-        double cluster2Angle = cluster2.getAngle();
-        double cluster3Angle = cluster3.getAngle();
-
-        if (numClusters == 1) {
-            angle = cluster1Angle;
-            size = 1 - cos(degreesToRadians(angleBetween(cluster1.getLeftAngle(), cluster1.getRightAngle()) / 2.0));
+    #if LS_LINE_TABLE
+        if (numClusters == 0) {
+            angle = NO_LINE_ANGLE * 100;
+            size = NO_LINE_SIZE * 100;
+        } else if (numClusters == 1) {
+            int centre, width;
+            clusterEdges(cluster1, centre, width);
+
+            angle = centre * 36000 / (LS_NUM * 16);
+            size = lineSizes[width * 360 / (LS_NUM * 16)];
         } else if (numClusters == 2) {
-            angle = angleBetween(cluster1Angle, cluster2Angle) <= 180 ? midAngleBetween(cluster1Angle, cluster2Angle) : midAngleBetween(cluster2Angle, cluster1Angle);
-            size = 1 - cos(degreesToRadians(angleBetween(cluster1Angle, cluster2Angle) <= 180 ? angleBetween(cluster1Angle, cluster2Angle) / 2.0 : angleBetween(cluster2Angle, cluster1Angle) / 2.0));
+            int centre1, centre2, width;
+            clusterEdges(cluster1, centre1, width);
+            clusterEdges(cluster2, centre2, width);
+
+            if (angleBetweenCentres(centre1, centre2) <= 180) {
+                angle = midAngleOfCentres(centre1, centre2) * 100;
+                size = lineSizes[angleBetweenCentres(centre1, centre2)];
+            } else {
+                angle = midAngleOfCentres(centre2, centre1) * 100;
+                size = lineSizes[angleBetweenCentres(centre2, centre1)];
+            }
         } else {
-            double angleDiff12 = angleBetween(cluster1Angle, cluster2Angle);
-            double angleDiff23 = angleBetween(cluster2Angle, cluster3Angle);
-            double angleDiff31 = angleBetween(cluster3Angle, cluster1Angle);
+            int centre1, centre2, centre3, width;
+            clusterEdges(cluster1, centre1, width);
+            clusterEdges(cluster2, centre2, width);
+            clusterEdges(cluster3, centre3, width);
+
+            int angleDiff12 = angleBetweenCentres(centre1, centre2);
+            int angleDiff23 = angleBetweenCentres(centre2, centre3);
+            int angleDiff31 = angleBetweenCentres(centre3, centre1);
 
-            double biggestAngle = max(angleDiff12, max(angleDiff23, angleDiff31));
+            int biggestAngle = max(angleDiff12, max(angleDiff23, angleDiff31));
+
+            int from, to;
 
             if (angleDiff12 == biggestAngle) {
-                angle = midAngleBetween(cluster2Angle, cluster1Angle);
-                size = angleBetween(cluster2Angle, cluster1Angle) <= 180 ? 1 - cos(degreesToRadians(angleBetween(cluster2Angle, cluster1Angle) / 2.0)) : 1;
+                from = centre2;
+                to = centre1;
             } else if (angleDiff23 == biggestAngle) {
-                angle = midAngleBetween(cluster3Angle, cluster2Angle);
-                size = angleBetween(cluster3Angle, cluster2Angle) <= 180 ? 1 - cos(degreesToRadians(angleBetween(cluster3Angle, cluster2Angle) / 2.0)) : 1;
+                from = centre3;
+                to = centre2;
             } else {
-                angle = midAngleBetween(cluster1Angle, cluster3Angle);
-                size = angleBetween(cluster1Angle, cluster3Angle) <= 180 ? 1 - cos(degreesToRadians(angleBetween(cluster1Angle, cluster3Angle) / 2.0)) : 1;
+                from = centre1;
+                to = centre3;
             }
+
+            angle = midAngleOfCentres(from, to) * 100;
+            size = angleBetweenCentres(from, to) <= 180 ? lineSizes[angleBetweenCentres(from, to)] : 100;
         }
-    }
+    #else
+        if (numClusters == 0) {
+            angle = NO_LINE_ANGLE;
+            size = NO_LINE_SIZE;
+        } else {
+            double cluster1Angle = cluster1.getAngle();
+            double cluster2Angle = cluster2.getAngle();
+            double cluster3Angle = cluster3.getAngle();
+
+            if (numClusters == 1) {
+                angle = cluster1Angle;
+                size = 1 - cos(degreesToRadians(angleBetween(cluster1.getLeftAngle(), cluster1.getRightAngle()) / 2.0));
+            } else if (numClusters == 2) {
+                angle = angleBetween(cluster1Angle, cluster2Angle) <= 180 ? midAngleBetween(cluster1Angle, cluster2Angle) : midAngleBetween(cluster2Angle, cluster1Angle);
+                size = 1 - cos(degreesToRadians(angleBetween(cluster1Angle, cluster2Angle) <= 180 ? angleBetween(cluster1Angle, cluster2Angle) / 2.0 : angleBetween(cluster2Angle, cluster1Angle) / 2.0));
+            } else {
+                double angleDiff12 = angleBetween(cluster1Angle, cluster2Angle);
+                double angleDiff23 = angleBetween(cluster2Angle, cluster3Angle);
+                double angleDiff31 = angleBetween(cluster3Angle, cluster1Angle);
+
+                double biggestAngle = max(angleDiff12, max(angleDiff23, angleDiff31));
+
+                if (angleDiff12 == biggestAngle) {
+                    angle = midAngleBetween(cluster2Angle, cluster1Angle);
+                    size = angleBetween(cluster2Angle, cluster1Angle) <= 180 ? 1 - cos(degreesToRadians(angleBetween(cluster2Angle, cluster1Angle) / 2.0)) : 1;
+                } else if (angleDiff23 == biggestAngle) {
+                    angle = midAngleBetween(cluster3Angle, cluster2Angle);
+                    size = angleBetween(cluster3Angle, cluster2Angle) <= 180 ? 1 - cos(degreesToRadians(angleBetween(cluster3Angle, cluster2Angle) / 2.0)) : 1;
+                } else {
+                    angle = midAngleBetween(cluster1Angle, cluster3Angle);
+                    size = angleBetween(cluster1Angle, cluster3Angle) <= 180 ? 1 - cos(degreesToRadians(angleBetween(cluster1Angle, cluster3Angle) / 2.0)) : 1;
+                }
+            }
+        }
+    #endif
 }
 
 void LightSensorArray::resetClusters() {
@@ -164,11 +363,19 @@ void LightSensorArray::resetClusters() {
 }
 
 double LightSensorArray::getLineAngle() {
-    return angle;
+    #if LS_LINE_TABLE
+        return angle / 100.0;
+    #else
+        return angle;
+    #endif
 }
 
 double LightSensorArray::getLineSize() {
-    return size;
+    #if LS_LINE_TABLE
+        return size / 100.0;
+    #else
+        return size;
+    #endif
 }
 
 uint16_t LightSensorArray::getFirst16Bit() {
@@ -7,6 +7,14 @@
 #include <LightSensorCluster.h>
 #include <Bits.h>
 #include <Common.h>
+#include <Timer.h>
+#include <ADCScanner.h>
+
+#if LS_DMA_SCAN && !defined(NATIVE)
+    #define LS_SCANNED true
+#else
+    #define LS_SCANNED false
+#endif
 
 class LightSensorArray {
 public:
@@ -14,6 +22,7 @@ public:
 
     void init();
 
+    bool frameReady();
     void read();
 
     void calculateClusters(bool doneFillInSensors = false);
@@ -30,6 +39,10 @@ public:
     bool data[LS_NUM];
     bool filledInData[LS_NUM];
 
+    // Bit i is set if sensor i is on white
+    uint32_t dataMask = 0;
+    uint32_t filledInMask = 0;
+
     LightSensorCluster cluster1 = LightSensorCluster(0.0, 0);
     LightSensorCluster cluster2 = LightSensorCluster(0.0, 0);
     LightSensorCluster cluster3 = LightSensorCluster(0.0, 0);
@@ -39,10 +52,31 @@ public:
 private:
     void resetClusters();
 
+    #if LS_LINE_TABLE
+        void clusterEdges(LightSensorCluster &cluster, int &centre, int &width);
+    #endif
+
     int lsPins[LS_NUM] = {LS_0, LS_1, LS_2, LS_3, LS_4, LS_5, LS_6, LS_7, LS_8, LS_9, LS_10, LS_11, LS_12, LS_13, LS_14, LS_15, LS_16, LS_17, LS_18, LS_19, LS_20, LS_21, LS_22, LS_23};
 
-    double angle;
-    double size;
+    #if LS_SCANNED
+        ADCScanner scanner;
+    #endif
+
+    #if LS_ADAPTIVE_THRESHOLDS
+        Timer levelTimer = Timer(LS_LEVEL_UPDATE_TIME);
+    #endif
+
+    #if LS_LINE_TABLE
+        // In hundredths, as they are sent to the master
+        int angle;
+        int size;
+
+        // Line size of each span between clusters in whole degrees
+        uint8_t lineSizes[360];
+    #else
+        double angle;
+        double size;
+    #endif
 };
 
 #endif // LIGHT_SENSOR_ARRAY_H
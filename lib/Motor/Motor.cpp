@@ -17,35 +17,55 @@ Motor::Motor(int pwm, int inOne, int inTwo, int standby, int angle, bool reverse
 }
 
 void Motor::move(int speed) {
-	if (speed > 0) {
-		analogWrite(pwmPin, constrain(speed, 0, 255));
-
-		if (reversed) {
-			digitalWrite(inOnePin, HIGH);
-			digitalWrite(inTwoPin, LOW);
-		} else {
-			digitalWrite(inOnePin, LOW);
-			digitalWrite(inTwoPin, HIGH);
+	int direction = speed > 0 ? 1 : (speed < 0 ? -1 : 0);
+
+	if (direction == 0) {
+		brake();
+	} else {
+		braked = false;
+
+		int duty = min(abs(speed), 255);
+
+		if (duty != outputDuty) {
+			analogWrite(pwmPin, duty);
+			outputDuty = duty;
 		}
-	} else if (speed < 0) {
-		analogWrite(pwmPin, constrain(abs(speed), 0, 255));
-
-		if (reversed) {
-			digitalWrite(inOnePin, LOW);
-			digitalWrite(inTwoPin, HIGH);
-		} else {
-			digitalWrite(inOnePin, HIGH);
-			digitalWrite(inTwoPin, LOW);
+
+		if (direction != outputDirection) {
+			bool inOne = (direction > 0) == reversed;
+
+			writePin(inOnePin, inOne);
+			writePin(inTwoPin, !inOne);
+			outputDirection = direction;
 		}
-	} else {
-		brake();
 	}
 
-	digitalWrite(standbyPin, HIGH);
+	if (!standbyWritten) {
+		digitalWrite(standbyPin, HIGH);
+		standbyWritten = true;
+	}
 }
 
 void Motor::brake() {
-	digitalWrite(inOnePin, HIGH);
-	digitalWrite(inTwoPin, HIGH);
+	if (braked) {
+		return;
+	}
+
+	writePin(inOnePin, HIGH);
+	writePin(inTwoPin, HIGH);
 	digitalWrite(pwmPin, HIGH);
+
+	// Both the direction and the PWM pin have to be written again to move
+	braked = true;
+	outputDuty = -1;
+	outputDirection = 0;
+}
+
+void Motor::writePin(int pin, bool value) {
+	#ifdef NATIVE
+		digitalWrite(pin, value);
+	#else
+		// The pin's bit band alias in the GPIO set or clear register, from the Teensy core
+		*(value ? portSetRegister(pin) : portClearRegister(pin)) = 1;
+	#endif
 }
@@ -19,6 +19,15 @@ private:
 	int inTwoPin;
 	int standbyPin;
 	bool reversed;
+
+	// What the driver was last given so unchanged commands aren't written
+	// again, direction is 1 or -1 and 0 before the first move
+	int outputDuty = -1;
+	int outputDirection = 0;
+	bool braked = false;
+	bool standbyWritten = false;
+
+	void writePin(int pin, bool value);
 };
 
 #endif
@@ -7,41 +7,55 @@ MotorArray::MotorArray() {
     motorBackLeft = Motor(MOTOR_BACK_LEFT_PWM, MOTOR_BACK_LEFT_IN1, MOTOR_BACK_LEFT_IN2, MOTOR_BACK_LEFT_SB, MOTOR_BACK_LEFT_ANGLE, MOTOR_BACK_LEFT_REVERSED);
 }
 
-void MotorArray::move(int angle, int rotation, int speed) {
-    angle = mod(90 - angle, 360);
+// Division rounded to the nearest integer, half away from zero
+static int divideRounded(int numerator, int denominator) {
+    return (numerator < 0 ? numerator - denominator / 2 : numerator + denominator / 2) / denominator;
+}
+
+void MotorArray::move(int angle, int rotation, int speed, bool immediate) {
+    int speeds[4];
+    mix(angle, rotation, speed, speeds);
+
+    #if MOTOR_RAMP
+        ramp(speeds, immediate);
+    #endif
 
-    double a = cos(degreesToRadians(angle)) / sin(degreesToRadians(MOTOR_ANGLE));
-    double b = sin(degreesToRadians(angle)) / cos(degreesToRadians(MOTOR_ANGLE));
+    motorRight.move(speeds[0]);
+    motorLeft.move(speeds[1]);
+    motorBackRight.move(speeds[2]);
+    motorBackLeft.move(speeds[3]);
+}
 
-    double motorRightValue = a - b;
-    double motorBackRightValue = -a - b;
-    double motorBackLeftValue = b - a;
-    double motorLeftValue = a + b;
+void MotorArray::mix(int angle, int rotation, int speed, int *speeds) {
+    int x = fixedSin(angle);
+    int y = fixedCos(angle);
 
-    double updatedSpeed = (double) speed / doubleAbs(fmax(fmax(fmax(doubleAbs(motorLeftValue), doubleAbs(motorRightValue)), doubleAbs(motorBackRightValue)), doubleAbs(motorBackLeftValue)));
+    int values[4];
+    int largestValue = 0;
 
-    int motorRightSpeed = (int) round(motorRightValue * updatedSpeed) + rotation;
-    int motorLeftSpeed = (int) round(motorLeftValue * updatedSpeed) + rotation;
-    int motorBackRightSpeed = (int) round(motorBackRightValue * updatedSpeed) + rotation;
-    int motorBackLeftSpeed = (int) round(motorBackLeftValue * updatedSpeed) + rotation;
+    for (int i = 0; i < 4; i++) {
+        values[i] = (MOTOR_MIXING[i][0] * x + MOTOR_MIXING[i][1] * y) >> 14;
+        largestValue = max(largestValue, abs(values[i]));
+    }
 
-    double updatedSpeed2 = (double) 255 / doubleAbs(fmax(fmax(fmax(doubleAbs(motorLeftSpeed), doubleAbs(motorRightSpeed)), doubleAbs(motorBackRightSpeed)), doubleAbs(motorBackLeftSpeed)));
+    // The fastest wheel moves at the speed, then the rotation is added and
+    // everything is scaled down together if a wheel is past full power
+    int largestSpeed = 0;
 
-    if (updatedSpeed2 < 1) {
-        int motorRightSpeed = (int) round(motorRightSpeed * updatedSpeed2);
-        int motorLeftSpeed = (int) round(motorLeftSpeed * updatedSpeed2);
-        int motorBackRightSpeed = (int) round(motorBackRightSpeed * updatedSpeed2);
-        int motorBackLeftSpeed = (int) round(motorBackLeftSpeed * updatedSpeed2);
+    for (int i = 0; i < 4; i++) {
+        speeds[i] = divideRounded(values[i] * speed, largestValue) + rotation;
+        largestSpeed = max(largestSpeed, abs(speeds[i]));
     }
 
-    motorRight.move(motorRightSpeed);
-    motorLeft.move(motorLeftSpeed);
-    motorBackRight.move(motorBackRightSpeed);
-    motorBackLeft.move(motorBackLeftSpeed);
+    if (largestSpeed > 255) {
+        for (int i = 0; i < 4; i++) {
+            speeds[i] = divideRounded(speeds[i] * 255, largestSpeed);
+        }
+    }
 }
 
 void MotorArray::move(MoveData data) {
-    move(data.angle, data.rotation, data.speed);
+    move(data.angle, data.rotation, data.speed, data.immediate);
 }
 
 void MotorArray::brake() {
@@ -49,4 +63,51 @@ void MotorArray::brake() {
     motorLeft.brake();
     motorBackRight.brake();
     motorBackLeft.brake();
+
+    for (int i = 0; i < 4; i++) {
+        rampSpeeds[i] = 0;
+    }
+
+    rampRate = 0;
+    ramping = false;
+}
+
+void MotorArray::ramp(int *speeds, bool immediate) {
+    // The first move after boot or a brake starts the clock rather than
+    // counting all the time since as ramping
+    unsigned long time = micros();
+    float elapsed = ramping ? (time - lastMoveTime) / 1000000.0f : 0;
+    lastMoveTime = time;
+    ramping = true;
+
+    float largestChange = 0;
+
+    for (int i = 0; i < 4; i++) {
+        largestChange = max(largestChange, fabsf(speeds[i] - rampSpeeds[i]));
+    }
+
+    if (immediate || largestChange == 0) {
+        for (int i = 0; i < 4; i++) {
+            rampSpeeds[i] = speeds[i];
+        }
+
+        rampRate = 0;
+        return;
+    }
+
+    #if MOTOR_MAX_JERK > 0
+        // Build up to full acceleration and ease off in time to arrive without overshooting
+        float targetRate = min((float)MOTOR_MAX_ACCELERATION, sqrtf(2.0f * MOTOR_MAX_JERK * largestChange));
+        rampRate += constrain(targetRate - rampRate, -MOTOR_MAX_JERK * elapsed, MOTOR_MAX_JERK * elapsed);
+    #else
+        rampRate = MOTOR_MAX_ACCELERATION;
+    #endif
+
+    // Every wheel goes the same fraction of the way so the robot keeps its direction
+    float fraction = min(rampRate * elapsed / largestChange, 1.0f);
+
+    for (int i = 0; i < 4; i++) {
+        rampSpeeds[i] += (speeds[i] - rampSpeeds[i]) * fraction;
+        speeds[i] = (int)roundf(rampSpeeds[i]);
+    }
 }
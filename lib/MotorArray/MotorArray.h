@@ -8,6 +8,16 @@
 #include <Motor.h>
 #include <Config.h>
 
+// Translation of the right, left, back right and back left wheels for a unit
+// move right (x) and forwards (y) in Q14. Each row is the exact mixing scaled
+// by sin(MOTOR_ANGLE)cos(MOTOR_ANGLE), which normalising to the speed cancels
+constexpr int MOTOR_MIXING[4][2] = {
+    {fixedCos(MOTOR_ANGLE), -fixedSin(MOTOR_ANGLE)},
+    {fixedCos(MOTOR_ANGLE), fixedSin(MOTOR_ANGLE)},
+    {-fixedCos(MOTOR_ANGLE), -fixedSin(MOTOR_ANGLE)},
+    {-fixedCos(MOTOR_ANGLE), fixedSin(MOTOR_ANGLE)}
+};
+
 class MotorArray {
 public:
     Motor motorRight;
@@ -16,9 +26,21 @@ public:
     Motor motorBackLeft;
 
     MotorArray();
-    void move(int angle, int rotation, int speed);
+    void move(int angle, int rotation, int speed, bool immediate = false);
     void move(MoveData data);
     void brake();
+
+    // Wheel speeds for a move, before ramping
+    static void mix(int angle, int rotation, int speed, int *speeds);
+
+private:
+    // Where each wheel's speed has ramped to and how fast it is ramping
+    float rampSpeeds[4] = {0};
+    float rampRate = 0;
+    unsigned long lastMoveTime = 0;
+    bool ramping = false;
+
+    void ramp(int *speeds, bool immediate);
 };
 
 #endif // MOTOR_ARRAY_H
@@ -4,6 +4,9 @@
 typedef struct MoveData {
     int angle = 0, speed = 0, rotation = 0;
 
+    // Skips the motor ramp, for getting away from the line
+    bool immediate = false;
+
     MoveData() {}
     MoveData(int moveAngle, int moveSpeed, int moveRotation) {
         angle = moveAngle;
@@ -41,6 +41,13 @@
 #define TSOP_PWR_3 31
 #define TSOP_PWR_4 32
 
+// The TSOPs powered by each TSOP_PWR pin, bit i is TSOP i. TSOPArray::init()
+// measures the groups at boot and only falls back to these if that fails
+#define TSOP_PWR_1_TSOPS 0x00003F
+#define TSOP_PWR_2_TSOPS 0x000FC0
+#define TSOP_PWR_3_TSOPS 0x03F000
+#define TSOP_PWR_4_TSOPS 0xFC0000
+
 // Light Gate
 
 #define LIGHT_GATE A20
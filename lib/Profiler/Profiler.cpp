@@ -0,0 +1,115 @@
+#include "Profiler.h"
+
+ProfilerStage *Profiler::stages = nullptr;
+
+ProfilerStage::ProfilerStage(const char *stageName) {
+    name = stageName;
+
+    // Stages are printed in the order they are declared
+    next = nullptr;
+
+    if (Profiler::stages == nullptr) {
+        Profiler::stages = this;
+    } else {
+        ProfilerStage *last = Profiler::stages;
+
+        while (last->next != nullptr) {
+            last = last->next;
+        }
+
+        last->next = this;
+    }
+}
+
+void ProfilerStage::record(uint32_t duration) {
+    samples[sampleIndex] = duration;
+    sampleIndex = (sampleIndex + 1) % PROFILER_RING_SIZE;
+
+    if (sampleCount < PROFILER_RING_SIZE) {
+        sampleCount++;
+    }
+
+    if (duration < minDuration) {
+        minDuration = duration;
+    }
+
+    if (duration > maxDuration) {
+        maxDuration = duration;
+    }
+
+    totalDuration += duration;
+    count++;
+}
+
+void ProfilerStage::reset() {
+    sampleIndex = 0;
+    sampleCount = 0;
+    minDuration = UINT32_MAX;
+    maxDuration = 0;
+    totalDuration = 0;
+    count = 0;
+}
+
+double ProfilerStage::minimum() {
+    return count == 0 ? 0 : (double)minDuration / PROFILER_TICKS_PER_MICROSECOND;
+}
+
+double ProfilerStage::mean() {
+    return count == 0 ? 0 : (double)totalDuration / count / PROFILER_TICKS_PER_MICROSECOND;
+}
+
+double ProfilerStage::percentile(int percent) {
+    if (sampleCount == 0) {
+        return 0;
+    }
+
+    // Only called on demand, so a simple insertion sort of a copy is fine
+    uint32_t sorted[PROFILER_RING_SIZE];
+
+    for (int i = 0; i < sampleCount; i++) {
+        int j = i;
+
+        while (j > 0 && sorted[j - 1] > samples[i]) {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+
+        sorted[j] = samples[i];
+    }
+
+    int index = constrain((sampleCount * percent + 99) / 100 - 1, 0, sampleCount - 1);
+
+    return (double)sorted[index] / PROFILER_TICKS_PER_MICROSECOND;
+}
+
+double ProfilerStage::maximum() {
+    return (double)maxDuration / PROFILER_TICKS_PER_MICROSECOND;
+}
+
+String ProfilerStage::summary() {
+    return String(name) + ": " + String(minimum()) + "/" + String(mean()) + "/" + String(percentile(99)) + "/" + String(maximum());
+}
+
+void Profiler::init() {
+    #ifndef NATIVE
+        // Enable the DWT cycle counter
+        ARM_DEMCR |= ARM_DEMCR_TRCENA;
+        ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+    #endif
+}
+
+void Profiler::reset() {
+    for (ProfilerStage *stage = stages; stage != nullptr; stage = stage->next) {
+        stage->reset();
+    }
+}
+
+String Profiler::summary() {
+    String summaryString = "stage: min/mean/p99/max us";
+
+    for (ProfilerStage *stage = stages; stage != nullptr; stage = stage->next) {
+        summaryString += "\n" + stage->summary();
+    }
+
+    return summaryString;
+}
@@ -0,0 +1,87 @@
+/* Lightweight scoped profiler for timing the stages of a loop.
+ *
+ * Each ProfilerStage keeps the running min/max/mean of its durations and a
+ * ring of the most recent PROFILER_RING_SIZE durations for the percentile.
+ * Time is measured with the DWT cycle counter on the Teensy and
+ * steady_clock natively. Wrap a block with PROFILE(stage) to time it.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+#include <Config.h>
+
+#ifdef NATIVE
+    #include <chrono>
+
+    #define PROFILER_TICKS_PER_MICROSECOND 1000
+#else
+    #define PROFILER_TICKS_PER_MICROSECOND (F_CPU / 1000000)
+#endif
+
+class ProfilerStage {
+public:
+    ProfilerStage(const char *stageName);
+
+    void record(uint32_t duration);
+    void reset();
+
+    double minimum();
+    double mean();
+    double percentile(int percent);
+    double maximum();
+
+    String summary();
+
+    const char *name;
+    ProfilerStage *next;
+
+private:
+    uint32_t samples[PROFILER_RING_SIZE];
+    int sampleIndex = 0;
+    int sampleCount = 0;
+
+    uint32_t minDuration = UINT32_MAX;
+    uint32_t maxDuration = 0;
+    uint64_t totalDuration = 0;
+    uint32_t count = 0;
+};
+
+class Profiler {
+public:
+    static void init();
+    static void reset();
+    static String summary();
+
+    static ProfilerStage *stages;
+
+    static inline uint32_t ticks() {
+        #ifdef NATIVE
+            return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        #else
+            return ARM_DWT_CYCCNT;
+        #endif
+    }
+};
+
+class ProfilerScope {
+public:
+    ProfilerScope(ProfilerStage &profilerStage) : stage(profilerStage), start(Profiler::ticks()) {}
+
+    ~ProfilerScope() {
+        stage.record(Profiler::ticks() - start);
+    }
+
+private:
+    ProfilerStage &stage;
+    uint32_t start;
+};
+
+#if PROFILER_ENABLED
+    #define PROFILE(stage) ProfilerScope profilerScope(stage)
+#else
+    #define PROFILE(stage)
+#endif
+
+#endif // PROFILER_H
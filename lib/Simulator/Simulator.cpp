@@ -0,0 +1,871 @@
+#include "Simulator.h"
+
+// Install the simulator before any other static object touches the HAL
+static Simulator simulator __attribute__((init_priority(101)));
+
+Simulator::Simulator() {
+    int tsopPins[TSOP_NUM] = {TSOP_0, TSOP_1, TSOP_2, TSOP_3, TSOP_4, TSOP_5, TSOP_6, TSOP_7, TSOP_8, TSOP_9, TSOP_10, TSOP_11, TSOP_12, TSOP_13, TSOP_14, TSOP_15, TSOP_16, TSOP_17, TSOP_18, TSOP_19, TSOP_20, TSOP_21, TSOP_22, TSOP_23};
+    int lsPins[LS_NUM] = {LS_0, LS_1, LS_2, LS_3, LS_4, LS_5, LS_6, LS_7, LS_8, LS_9, LS_10, LS_11, LS_12, LS_13, LS_14, LS_15, LS_16, LS_17, LS_18, LS_19, LS_20, LS_21, LS_22, LS_23};
+
+    for (int i = 0; i < HAL_NUM_PINS; i++) {
+        tsopIndexes[i] = -1;
+        lightSensorIndexes[i] = -1;
+    }
+
+    for (int i = 0; i < TSOP_NUM; i++) {
+        tsopIndexes[tsopPins[i]] = i;
+    }
+
+    for (int i = 0; i < LS_NUM; i++) {
+        lightSensorIndexes[lsPins[i]] = i;
+    }
+
+    // Drawn without disturbing the random sequence of the matches
+    uint32_t matchRandomState = randomState;
+
+    for (int i = 0; i < TSOP_NUM; i++) {
+        tsopSensitivities[i] = 1 + SIMULATOR_TSOP_MISMATCH * (2 * randomDouble() - 1);
+    }
+
+    for (int i = 0; i < LS_NUM; i++) {
+        lightSensorGains[i] = 1 + SIMULATOR_LS_MISMATCH * (2 * randomDouble() - 1);
+    }
+
+    randomState = matchRandomState;
+
+    kickOff();
+
+    HAL::setBackend(this);
+}
+
+uint32_t Simulator::micros() {
+    return (uint32_t)(board == SimulatorBoard::tsopBoard ? tsopTime : now);
+}
+
+void Simulator::delayMicroseconds(uint32_t duration) {
+    advance(duration);
+}
+
+uint8_t Simulator::digitalRead(uint8_t pin) {
+    if (board == SimulatorBoard::tsopBoard && tsopIndexes[pin] != -1) {
+        // TSOPs pull their output low while they receive the ball, and the
+        // output reads low while a TSOP is unpowered
+        if (!((tsopsPowered >> tsopIndexes[pin]) & 1)) {
+            return LOW;
+        }
+
+        return randomDouble() < tsopProbabilities[tsopIndexes[pin]] ? LOW : HIGH;
+    }
+
+    return HALBackend::digitalRead(pin);
+}
+
+void Simulator::digitalWrite(uint8_t pin, uint8_t value) {
+    if (board == SimulatorBoard::tsopBoard) {
+        int powerPins[TSOP_POWER_GROUPS] = {TSOP_PWR_1, TSOP_PWR_2, TSOP_PWR_3, TSOP_PWR_4};
+        uint32_t powerGroupTSOPs[TSOP_POWER_GROUPS] = {TSOP_PWR_1_TSOPS, TSOP_PWR_2_TSOPS, TSOP_PWR_3_TSOPS, TSOP_PWR_4_TSOPS};
+
+        for (int i = 0; i < TSOP_POWER_GROUPS; i++) {
+            if (pin == powerPins[i]) {
+                tsopsPowered = value == HIGH ? tsopsPowered | powerGroupTSOPs[i] : tsopsPowered & ~powerGroupTSOPs[i];
+                return;
+            }
+        }
+    }
+
+    HALBackend::digitalWrite(pin, value);
+}
+
+int Simulator::analogRead(uint8_t pin) {
+    if (board == SimulatorBoard::lightBoard && lightSensorIndexes[pin] != -1) {
+        int index = lightSensorIndexes[pin];
+        Vector2D point = lightSensorPosition(index);
+
+        double reflected = SIMULATOR_LS_GREEN + whiteFraction(point) * (SIMULATOR_LS_WHITE - SIMULATOR_LS_GREEN);
+        double lighting = 1 + SIMULATOR_LS_GRADIENT * point.y / SIMULATOR_FIELD_LENGTH;
+
+        int noise = (int)(random() % (2 * SIMULATOR_LS_NOISE + 1)) - SIMULATOR_LS_NOISE;
+        return (int)round(lightSensorGains[index] * lighting * reflected) + noise;
+    }
+
+    return HALBackend::analogRead(pin);
+}
+
+uint16_t Simulator::spiTransfer16(uint8_t cs, uint16_t data) {
+    initialiseSlaves();
+    advance(SIMULATOR_SPI_TRANSFER_TIME);
+
+    // The slaves' ISRs push the answer they worked out for the previous word
+    // and then work out the next, so the reply is two words late
+    uint16_t reply = 0;
+
+    if (cs == MASTER_CS_TSOP) {
+        reply = tsopDataPushed;
+        tsopDataPushed = tsopDataOut;
+        tsopDataOut = respondTSOP(data);
+    } else if (cs == MASTER_CS_LIGHT) {
+        updateLightSlave();
+        reply = lightDataPushed;
+        lightDataPushed = lightDataOut;
+        lightDataOut = respondLight(data);
+    }
+
+    return reply;
+}
+
+void Simulator::i2cBegin(uint32_t rate) {
+    i2cByteTime = (9000000 + rate - 1) / rate;
+}
+
+uint8_t Simulator::i2cWrite(uint8_t address, const uint8_t *data, uint8_t length) {
+    advance((length + 1) * i2cByteTime);
+
+    if (length == 1) {
+        i2cRegisters[address & 0x7F] = data[0];
+    } else if (length == 2 && address == MPU9250_ADDRESS && data[0] == 0x6A) {
+        // USER_CTRL, FIFO_EN and FIFO_RST
+        gyroFIFOEnabled = data[1] & 0x40;
+
+        if (data[1] & 0x04) {
+            gyroFIFOCount = 0;
+            gyroFIFOByte = 0;
+        }
+    }
+
+    return 0;
+}
+
+uint8_t Simulator::i2cRead(uint8_t address, uint8_t *data, uint8_t length) {
+    advance((length + 1) * i2cByteTime);
+    readI2CDevice(address, data, length);
+
+    return length;
+}
+
+uint32_t Simulator::i2cRequest(uint8_t address, uint8_t *data, uint8_t length) {
+    // The device is sampled when the request starts
+    readI2CDevice(address, data, length);
+
+    return (uint32_t)(now + (length + 1) * i2cByteTime);
+}
+
+void Simulator::readI2CDevice(uint8_t address, uint8_t *data, uint8_t length) {
+    memset(data, 0, length);
+
+    if (address == MPU9250_ADDRESS && i2cRegisters[address] == MPU9250_FIFO_COUNT && length >= 2) {
+        int bytes = gyroFIFOCount * 2 - gyroFIFOByte;
+        data[0] = bytes >> 8;
+        data[1] = bytes & 0xFF;
+    } else if (address == MPU9250_ADDRESS && i2cRegisters[address] == MPU9250_FIFO_DATA) {
+        // Each sample is the high byte then the low byte
+        for (int i = 0; i < length && gyroFIFOCount > 0; i++) {
+            int16_t sample = gyroFIFO[gyroFIFOStart];
+            data[i] = gyroFIFOByte == 0 ? (uint8_t)(sample >> 8) : (uint8_t)(sample & 0xFF);
+
+            gyroFIFOByte++;
+
+            if (gyroFIFOByte == 2) {
+                gyroFIFOByte = 0;
+                gyroFIFOStart = (gyroFIFOStart + 1) % (MPU9250_FIFO_SIZE / 2);
+                gyroFIFOCount--;
+            }
+        }
+    } else if (address == MPU9250_ADDRESS) {
+        // Accelerometer, temperature and gyroscope registers from 0x3B
+        uint8_t registers[14] = {0};
+        int16_t gyroZ = gyroReading();
+        registers[12] = (uint8_t)(gyroZ >> 8);
+        registers[13] = (uint8_t)(gyroZ & 0xFF);
+
+        int start = i2cRegisters[address] - 0x3B;
+
+        for (int i = 0; i < length; i++) {
+            if (start + i >= 0 && start + i < 14) {
+                data[i] = registers[start + i];
+            }
+        }
+    } else if (address == MAG_ADDRESS) {
+        // ST1 (data is always ready), X, Y, Z and ST2 from 0x02. The IMU flips
+        // x and y and swaps them into the gyro's frame
+        int16_t x, y;
+        magReading(x, y);
+
+        uint8_t registers[8] = {0x01, (uint8_t)(-y & 0xFF), (uint8_t)(-y >> 8), (uint8_t)(-x & 0xFF), (uint8_t)(-x >> 8), 0, 0, 0};
+        int start = i2cRegisters[address] - 0x02;
+
+        for (int i = 0; i < length; i++) {
+            if (start + i >= 0 && start + i < 8) {
+                data[i] = registers[start + i];
+            }
+        }
+    } else if (address == PIXY_I2C_DEFAULT_ADDR) {
+        for (int i = 0; i < length; i++) {
+            if (pixyByteIndex >= pixyWordCount * 2) {
+                buildPixyFrame();
+            }
+
+            uint16_t word = pixyWords[pixyByteIndex / 2];
+            data[i] = pixyByteIndex % 2 == 0 ? word & 0xFF : word >> 8;
+            pixyByteIndex++;
+        }
+    }
+}
+
+bool Simulator::running() {
+    return match < SIMULATOR_MATCHES;
+}
+
+void Simulator::loopComplete() {
+    loops++;
+
+    double headingError = doubleMod(imuHeading - heading + 540, 360) - 180;
+    headingErrors += headingError;
+    headingSquares += headingError * headingError;
+    maxHeadingError = fmax(maxHeadingError, fabs(headingError));
+    headingErrorRate += headingError * angularVelocity;
+    rateSquares += angularVelocity * angularVelocity;
+
+    advance(SIMULATOR_LOOP_TIME);
+
+    if (now - matchStart >= SIMULATOR_MATCH_TIME) {
+        finishMatch();
+    }
+}
+
+void Simulator::headingUpdated(double heading) {
+    imuHeading = heading;
+}
+
+void Simulator::advance(uint32_t duration) {
+    now += duration;
+
+    while (physicsTime + SIMULATOR_PHYSICS_STEP <= now) {
+        stepPhysics(SIMULATOR_PHYSICS_STEP / 1000000.0);
+        physicsTime += SIMULATOR_PHYSICS_STEP;
+
+        while (nextGyroSample <= physicsTime) {
+            sampleGyro();
+            nextGyroSample += SIMULATOR_GYRO_SAMPLE_TIME;
+        }
+
+        updateTSOPSlave(physicsTime);
+    }
+
+    updateTSOPSlave(now);
+}
+
+void Simulator::stepPhysics(double dt) {
+    // Wheels follow the motor drivers with a first order lag
+    double targetSpeeds[4] = {
+        motorSpeed(MOTOR_RIGHT_PWM, MOTOR_RIGHT_IN1, MOTOR_RIGHT_IN2, MOTOR_RIGHT_REVERSED),
+        motorSpeed(MOTOR_LEFT_PWM, MOTOR_LEFT_IN1, MOTOR_LEFT_IN2, MOTOR_LEFT_REVERSED),
+        motorSpeed(MOTOR_BACK_RIGHT_PWM, MOTOR_BACK_RIGHT_IN1, MOTOR_BACK_RIGHT_IN2, MOTOR_BACK_RIGHT_REVERSED),
+        motorSpeed(MOTOR_BACK_LEFT_PWM, MOTOR_BACK_LEFT_IN1, MOTOR_BACK_LEFT_IN2, MOTOR_BACK_LEFT_REVERSED)
+    };
+    int wheelAngles[4] = {MOTOR_RIGHT_ANGLE, MOTOR_LEFT_ANGLE, MOTOR_BACK_RIGHT_ANGLE, MOTOR_BACK_LEFT_ANGLE};
+
+    double lag = 1 - exp(-dt / SIMULATOR_MOTOR_TIME_CONSTANT);
+
+    // Each wheel drives clockwise around the robot, so the body velocity is the
+    // least squares solution of wheelSpeed = velocity . tangent + rotation
+    double vx = 0, vy = 0, xx = 0, yy = 0, rotation = 0;
+
+    for (int i = 0; i < 4; i++) {
+        wheelSpeeds[i] += (targetSpeeds[i] - wheelSpeeds[i]) * lag;
+
+        double tangentX = sin(degreesToRadians(wheelAngles[i] + 90));
+        double tangentY = cos(degreesToRadians(wheelAngles[i] + 90));
+
+        vx += wheelSpeeds[i] * tangentX;
+        vy += wheelSpeeds[i] * tangentY;
+        xx += tangentX * tangentX;
+        yy += tangentY * tangentY;
+        rotation += wheelSpeeds[i] / 4.0;
+    }
+
+    vx /= xx;
+    vy /= yy;
+
+    double headingRadians = degreesToRadians(heading);
+    double targetVelocityX = vx * cos(headingRadians) + vy * sin(headingRadians);
+    double targetVelocityY = -vx * sin(headingRadians) + vy * cos(headingRadians);
+
+    #if SIMULATOR_TRACTION > 0
+        // The wheels can only change the robot's velocity (and the speed of the
+        // wheels around it) so fast before they slip
+        double rimSpeed = degreesToRadians(angularVelocity) * SIMULATOR_WHEEL_RADIUS;
+        double changeX = targetVelocityX - robot.velocity.x;
+        double changeY = targetVelocityY - robot.velocity.y;
+        double changeRim = rotation - rimSpeed;
+        double change = sqrt(changeX * changeX + changeY * changeY + changeRim * changeRim);
+        double grip = change > SIMULATOR_TRACTION * dt ? SIMULATOR_TRACTION * dt / change : 1;
+
+        robot.velocity.x += changeX * grip;
+        robot.velocity.y += changeY * grip;
+        angularVelocity = radiansToDegrees((rimSpeed + changeRim * grip) / SIMULATOR_WHEEL_RADIUS);
+    #else
+        robot.velocity.x = targetVelocityX;
+        robot.velocity.y = targetVelocityY;
+        angularVelocity = radiansToDegrees(rotation / SIMULATOR_WHEEL_RADIUS);
+    #endif
+
+    // Slip is how far each wheel's rim moves over the ground it is on
+    double groundX = robot.velocity.x * cos(headingRadians) - robot.velocity.y * sin(headingRadians);
+    double groundY = robot.velocity.x * sin(headingRadians) + robot.velocity.y * cos(headingRadians);
+    double groundRim = degreesToRadians(angularVelocity) * SIMULATOR_WHEEL_RADIUS;
+
+    for (int i = 0; i < 4; i++) {
+        double ground = groundX * sin(degreesToRadians(wheelAngles[i] + 90)) + groundY * cos(degreesToRadians(wheelAngles[i] + 90)) + groundRim;
+        wheelSlip += fabs(wheelSpeeds[i] - ground) * dt;
+    }
+
+    robot.position.x += robot.velocity.x * dt;
+    robot.position.y += robot.velocity.y * dt;
+    heading = doubleMod(heading + angularVelocity * dt, 360);
+
+    // The opponent guards the goal we attack
+    double targetX = fmax(-SIMULATOR_GOAL_WIDTH / 2.0, fmin(SIMULATOR_GOAL_WIDTH / 2.0, ball.position.x));
+    double targetY = SIMULATOR_FIELD_LENGTH / 2.0 - 2 * SIMULATOR_ROBOT_RADIUS;
+    double dx = targetX - opponent.position.x;
+    double dy = targetY - opponent.position.y;
+    double distance = sqrt(dx * dx + dy * dy);
+    double speed = fmin(SIMULATOR_OPPONENT_SPEED, distance / dt);
+
+    opponent.velocity.x = distance > 0 ? dx / distance * speed : 0;
+    opponent.velocity.y = distance > 0 ? dy / distance * speed : 0;
+    opponent.position.x += opponent.velocity.x * dt;
+    opponent.position.y += opponent.velocity.y * dt;
+
+    // Ball
+    double friction = exp(-dt / SIMULATOR_BALL_FRICTION_TIME);
+    ball.velocity.x *= friction;
+    ball.velocity.y *= friction;
+    ball.position.x += ball.velocity.x * dt;
+    ball.position.y += ball.velocity.y * dt;
+
+    collide(ball, SIMULATOR_BALL_RADIUS, robot, SIMULATOR_ROBOT_RADIUS, 0);
+    captureBall();
+    collide(ball, SIMULATOR_BALL_RADIUS, opponent, SIMULATOR_ROBOT_RADIUS, SIMULATOR_OPPONENT_KICK_SPEED);
+    collide(robot, SIMULATOR_ROBOT_RADIUS, opponent, SIMULATOR_ROBOT_RADIUS, 0);
+
+    // Being squeezed between two robots must not fire the ball off
+    double ballSpeed = sqrt(ball.velocity.x * ball.velocity.x + ball.velocity.y * ball.velocity.y);
+
+    if (ballSpeed > SIMULATOR_BALL_MAX_SPEED) {
+        ball.velocity.x *= SIMULATOR_BALL_MAX_SPEED / ballSpeed;
+        ball.velocity.y *= SIMULATOR_BALL_MAX_SPEED / ballSpeed;
+    }
+
+    constrainToField(robot, SIMULATOR_ROBOT_RADIUS, 0);
+    constrainToField(ball, SIMULATOR_BALL_RADIUS, SIMULATOR_WALL_RESTITUTION);
+
+    // Goals
+    if (fabs(ball.position.x) < SIMULATOR_GOAL_WIDTH / 2.0 && fabs(ball.position.y) > SIMULATOR_FIELD_LENGTH / 2.0) {
+        if (ball.position.y > 0) {
+            goalsFor++;
+        } else {
+            goalsAgainst++;
+        }
+
+        kickOff();
+        return;
+    }
+
+    // Out of bounds is when the whole ball or robot is past the outside of the line
+    double outX = SIMULATOR_FIELD_WIDTH / 2.0 + SIMULATOR_LINE_WIDTH / 2.0;
+    double outY = SIMULATOR_FIELD_LENGTH / 2.0 + SIMULATOR_LINE_WIDTH / 2.0;
+
+    if (fabs(ball.position.x) > outX + SIMULATOR_BALL_RADIUS || fabs(ball.position.y) > outY + SIMULATOR_BALL_RADIUS) {
+        ballOuts++;
+        placeBallNeutral();
+    }
+
+    // Lack of progress, the ball is moved when it has not moved for too long
+    double movedX = ball.position.x - progressPosition.x;
+    double movedY = ball.position.y - progressPosition.y;
+
+    if (movedX * movedX + movedY * movedY > SIMULATOR_PROGRESS_DISTANCE * SIMULATOR_PROGRESS_DISTANCE) {
+        progressPosition = ball.position;
+        progressTime = physicsTime;
+    } else if (physicsTime - progressTime > SIMULATOR_PROGRESS_TIME) {
+        lackOfProgress++;
+        placeBallNeutral();
+    }
+
+    bool robotIsOut = fabs(robot.position.x) > outX + SIMULATOR_ROBOT_RADIUS || fabs(robot.position.y) > outY + SIMULATOR_ROBOT_RADIUS;
+
+    if (robotIsOut && !robotWasOut) {
+        lineOuts++;
+    }
+
+    robotWasOut = robotIsOut;
+}
+
+void Simulator::kickOff() {
+    // The robot keeps its heading so that the IMU stays consistent
+    robot.position = {0, -SIMULATOR_FIELD_LENGTH / 4.0};
+    robot.velocity = {0, 0};
+
+    opponent.position = {0, SIMULATOR_FIELD_LENGTH / 2.0 - 2 * SIMULATOR_ROBOT_RADIUS};
+    opponent.velocity = {0, 0};
+
+    ball.position = {(randomDouble() - 0.5) * 0.8, (randomDouble() - 0.5) * 0.6};
+    ball.velocity = {0, 0};
+
+    progressPosition = ball.position;
+    progressTime = physicsTime;
+
+    ballPlacedTime = physicsTime;
+    ballReached = false;
+}
+
+void Simulator::placeBallNeutral() {
+    // Neutral spots are the centre and the four corner spots
+    Vector2D spots[5] = {{0, 0}, {-0.45, 0.45}, {0.45, 0.45}, {-0.45, -0.45}, {0.45, -0.45}};
+
+    ball.position = spots[random() % 5];
+    ball.velocity = {0, 0};
+
+    progressPosition = ball.position;
+    progressTime = physicsTime;
+
+    ballPlacedTime = physicsTime;
+    ballReached = false;
+}
+
+void Simulator::finishMatch() {
+    match++;
+
+    printf("Match %d: goals for %d, goals against %d, line outs %d, ball outs %d, lack of progress %d, time to ball %.2f s, wheel slip %.1f m, false lines %d, missed lines %d, heading error mean %.2f deg, rms %.2f deg, max %.2f deg, heading lag %.2f ms, average loop %.0f us\n", match, goalsFor, goalsAgainst, lineOuts, ballOuts, lackOfProgress, timeToBall / fmax(ballsReached, 1), wheelSlip, falseLines, missedLines, headingErrors / loops, sqrt(headingSquares / loops), maxHeadingError, -headingErrorRate / fmax(rateSquares, 1) * 1000, (double)(now - matchStart) / (double)loops);
+
+    totalGoalsFor += goalsFor;
+    totalGoalsAgainst += goalsAgainst;
+    totalLineOuts += lineOuts;
+    totalBallOuts += ballOuts;
+    totalLackOfProgress += lackOfProgress;
+    totalLoops += loops;
+    totalTimeToBall += timeToBall;
+    totalBallsReached += ballsReached;
+    totalWheelSlip += wheelSlip;
+    totalFalseLines += falseLines;
+    totalMissedLines += missedLines;
+    totalHeadingErrors += headingErrors;
+    totalHeadingSquares += headingSquares;
+    totalMaxHeadingError = fmax(totalMaxHeadingError, maxHeadingError);
+    totalHeadingErrorRate += headingErrorRate;
+    totalRateSquares += rateSquares;
+
+    if (!running()) {
+        printf("Total: %d matches, goals for %d, goals against %d, line outs %d, ball outs %d, lack of progress %d, time to ball %.2f s, wheel slip %.1f m, false lines %d, missed lines %d, heading error mean %.2f deg, rms %.2f deg, max %.2f deg, heading lag %.2f ms, average loop %.0f us\n", match, totalGoalsFor, totalGoalsAgainst, totalLineOuts, totalBallOuts, totalLackOfProgress, totalTimeToBall / fmax(totalBallsReached, 1), totalWheelSlip, totalFalseLines, totalMissedLines, totalHeadingErrors / totalLoops, sqrt(totalHeadingSquares / totalLoops), totalMaxHeadingError, -totalHeadingErrorRate / fmax(totalRateSquares, 1) * 1000, (double)now / (double)totalLoops);
+    }
+
+    goalsFor = 0;
+    goalsAgainst = 0;
+    lineOuts = 0;
+    ballOuts = 0;
+    lackOfProgress = 0;
+    loops = 0;
+    timeToBall = 0;
+    ballsReached = 0;
+    wheelSlip = 0;
+    falseLines = 0;
+    missedLines = 0;
+    headingErrors = 0;
+    headingSquares = 0;
+    maxHeadingError = 0;
+    headingErrorRate = 0;
+    rateSquares = 0;
+    matchStart = now;
+
+    kickOff();
+}
+
+double Simulator::motorSpeed(int pwm, int inOne, int inTwo, bool reversed) {
+    bool one = pinValues[inOne];
+    bool two = pinValues[inTwo];
+
+    if (one == two) {
+        // Braking
+        return 0;
+    }
+
+    double speed = constrain(analogValues[pwm], 0, 255) / 255.0 * SIMULATOR_WHEEL_SPEED;
+
+    return one == reversed ? speed : -speed;
+}
+
+void Simulator::collide(SimulatorBody &body, double radius, SimulatorBody &obstacle, double obstacleRadius, double kickSpeed) {
+    double dx = body.position.x - obstacle.position.x;
+    double dy = body.position.y - obstacle.position.y;
+    double distance = sqrt(dx * dx + dy * dy);
+
+    if (distance >= radius + obstacleRadius || distance == 0) {
+        return;
+    }
+
+    Vector2D normal = {dx / distance, dy / distance};
+
+    body.position.x = obstacle.position.x + normal.x * (radius + obstacleRadius);
+    body.position.y = obstacle.position.y + normal.y * (radius + obstacleRadius);
+
+    // Bounce off the obstacle in its frame of reference
+    double relativeX = body.velocity.x - obstacle.velocity.x;
+    double relativeY = body.velocity.y - obstacle.velocity.y;
+    double normalSpeed = relativeX * normal.x + relativeY * normal.y;
+
+    if (normalSpeed < 0) {
+        body.velocity.x -= (1 + SIMULATOR_BALL_RESTITUTION) * normalSpeed * normal.x;
+        body.velocity.y -= (1 + SIMULATOR_BALL_RESTITUTION) * normalSpeed * normal.y;
+    }
+
+    if (kickSpeed > 0) {
+        body.velocity.y = fmin(body.velocity.y, -kickSpeed);
+    }
+}
+
+void Simulator::captureBall() {
+    // A ball touching the front of the robot sits in its capture zone and is
+    // pushed along instead of bouncing off
+    double dx = ball.position.x - robot.position.x;
+    double dy = ball.position.y - robot.position.y;
+    double distance = sqrt(dx * dx + dy * dy);
+    double angle = doubleMod(radiansToDegrees(atan2(dx, dy)) - heading + 180, 360) - 180;
+
+    if (distance <= SIMULATOR_ROBOT_RADIUS + SIMULATOR_BALL_RADIUS + 0.005 && fabs(angle) < SIMULATOR_CAPTURE_ANGLE) {
+        if (!ballReached) {
+            timeToBall += (physicsTime - ballPlacedTime) / 1000000.0;
+            ballsReached++;
+            ballReached = true;
+        }
+
+        double relativeX = ball.velocity.x - robot.velocity.x;
+        double relativeY = ball.velocity.y - robot.velocity.y;
+
+        if (relativeX * dx + relativeY * dy < 0.05 * distance) {
+            ball.velocity = robot.velocity;
+        }
+    }
+}
+
+void Simulator::constrainToField(SimulatorBody &body, double radius, double restitution) {
+    double maxX = SIMULATOR_FIELD_WIDTH / 2.0 + SIMULATOR_OUTER_AREA - radius;
+    double maxY = SIMULATOR_FIELD_LENGTH / 2.0 + SIMULATOR_OUTER_AREA - radius;
+
+    if (fabs(body.position.x) > maxX) {
+        body.position.x = body.position.x > 0 ? maxX : -maxX;
+        body.velocity.x *= -restitution;
+    }
+
+    if (fabs(body.position.y) > maxY) {
+        body.position.y = body.position.y > 0 ? maxY : -maxY;
+        body.velocity.y *= -restitution;
+    }
+}
+
+bool Simulator::isOnWhite(Vector2D point) {
+    double halfWidth = SIMULATOR_FIELD_WIDTH / 2.0;
+    double halfLength = SIMULATOR_FIELD_LENGTH / 2.0;
+    double halfLine = SIMULATOR_LINE_WIDTH / 2.0;
+
+    bool onSide = fabs(fabs(point.x) - halfWidth) < halfLine && fabs(point.y) < halfLength + halfLine;
+    bool onEnd = fabs(fabs(point.y) - halfLength) < halfLine && fabs(point.x) < halfWidth + halfLine;
+
+    return onSide || onEnd;
+}
+
+Vector2D Simulator::lightSensorPosition(int index) {
+    double sensorAngle = degreesToRadians(heading + index * 360.0 / LS_NUM);
+    return {robot.position.x + SIMULATOR_LS_RADIUS * sin(sensorAngle), robot.position.y + SIMULATOR_LS_RADIUS * cos(sensorAngle)};
+}
+
+// How much of what a light sensor sees is white, from a grid over its spot
+double Simulator::whiteFraction(Vector2D point) {
+    if (SIMULATOR_LS_SPOT == 0) {
+        return isOnWhite(point) ? 1 : 0;
+    }
+
+    int white = 0;
+    int samples = 0;
+
+    for (int i = -4; i <= 4; i++) {
+        for (int j = -4; j <= 4; j++) {
+            if (i * i + j * j <= 16) {
+                white += isOnWhite({point.x + i * SIMULATOR_LS_SPOT / 4.0, point.y + j * SIMULATOR_LS_SPOT / 4.0});
+                samples++;
+            }
+        }
+    }
+
+    return (double)white / samples;
+}
+
+void Simulator::initialiseSlaves() {
+    if (slavesInitialised) {
+        return;
+    }
+
+    slavesInitialised = true;
+
+    board = SimulatorBoard::tsopBoard;
+    tsopTime = now;
+    tsops.init();
+
+    board = SimulatorBoard::lightBoard;
+    lightSensorArray.init();
+
+    board = SimulatorBoard::masterBoard;
+    nextTSOPFrame = now + SIMULATOR_TSOP_FRAME_TIME;
+}
+
+void Simulator::updateTSOPSlave(uint64_t time) {
+    // The TSOP slave reads on its own, so run every sub-frame it has finished
+    // by time and not just one per poll. The slaves' own delays don't move it on
+    if (!slavesInitialised || board != SimulatorBoard::masterBoard) {
+        return;
+    }
+
+    while (nextTSOPFrame <= time) {
+        tsopTime = nextTSOPFrame;
+        nextTSOPFrame += SIMULATOR_TSOP_FRAME_TIME;
+
+        updateTSOPFrame();
+    }
+}
+
+void Simulator::updateTSOPFrame() {
+    double dx = ball.position.x - robot.position.x;
+    double dy = ball.position.y - robot.position.y;
+    double distance = sqrt(dx * dx + dy * dy);
+    double ballAngle = radiansToDegrees(atan2(dx, dy)) - heading;
+    double ballStrength = SIMULATOR_TSOP_PEAK * exp(-fmax(distance - SIMULATOR_ROBOT_RADIUS, 0) / SIMULATOR_TSOP_FALLOFF);
+
+    for (int i = 0; i < TSOP_NUM; i++) {
+        double angleFactor = fmax(cos(degreesToRadians(ballAngle - i * 360.0 / TSOP_NUM)), 0);
+        tsopProbabilities[i] = fmin(tsopSensitivities[i] * ballStrength * angleFactor * angleFactor + SIMULATOR_TSOP_AMBIENT, 1);
+    }
+
+    board = SimulatorBoard::tsopBoard;
+
+    tsops.updateUnlock();
+
+    while (tsops.tsopCounter < TSOP_READ_SAMPLES) {
+        tsops.updateOnce();
+    }
+
+    tsops.finishRead();
+
+    uint16_t data[SLAVE_FRAME_DATA_LENGTH] = {(uint16_t)tsops.getAngle(), (uint16_t)tsops.getStrength(), 0};
+    tsopFrame.publish(data);
+
+    tsopTracker.update(tsops.getAngle(), tsops.getStrength());
+
+    uint16_t trackData[SLAVE_FRAME_DATA_LENGTH];
+    SlaveTSOP::packTrack(tsopTracker.getAngle(), tsops.getStrength(), tsopTracker.getAngularVelocity(), tsopTracker.getRange(), trackData);
+    tsopTrackingFrame.publish(trackData);
+
+    board = SimulatorBoard::masterBoard;
+}
+
+void Simulator::updateLightSlave() {
+    if (now < nextLightFrame) {
+        return;
+    }
+
+    nextLightFrame = now + SIMULATOR_LIGHT_FRAME_TIME;
+
+    board = SimulatorBoard::lightBoard;
+
+    lightSensorArray.read();
+    lightSensorArray.calculateClusters();
+    lightSensorArray.calculateLine();
+
+    // A false line is seen with every sensor on green, a missed one isn't
+    // seen with a sensor right over white
+    bool anyWhite = false;
+    bool centreOnWhite = false;
+
+    for (int i = 0; i < LS_NUM; i++) {
+        Vector2D point = lightSensorPosition(i);
+
+        anyWhite = anyWhite || whiteFraction(point) > 0;
+        centreOnWhite = centreOnWhite || isOnWhite(point);
+    }
+
+    bool lineSeen = lightSensorArray.numClusters > 0;
+
+    if (lineSeen && !anyWhite) {
+        falseLines++;
+    } else if (!lineSeen && centreOnWhite) {
+        missedLines++;
+    }
+
+    uint16_t data[SLAVE_FRAME_DATA_LENGTH] = {(uint16_t)round(lightSensorArray.getLineAngle() * 100), (uint16_t)round(lightSensorArray.getLineSize() * 100), 0};
+    lightFrame.publish(data);
+
+    board = SimulatorBoard::masterBoard;
+}
+
+uint16_t Simulator::respondTSOP(uint16_t command) {
+    // Mirrors spi0_isr in slave_tsop
+    uint16_t trackData[SLAVE_FRAME_DATA_LENGTH];
+    tsopTrackingFrame.read(trackData);
+    BallData trackedBall = SlaveTSOP::unpackTrack(trackData);
+
+    switch (command) {
+        case SlaveCommand::tsopAngle:
+            return tsopFrame.data(0);
+
+        case SlaveCommand::tsopStrength:
+            return tsopFrame.data(1);
+
+        case SlaveCommand::tsopTrackedAngle:
+            return trackedBall.angle;
+
+        case SlaveCommand::tsopAngularVelocity:
+            return (uint16_t)trackedBall.angularVelocity;
+
+        case SlaveCommand::tsopRange:
+            return trackedBall.range;
+
+        case SlaveCommand::snapshotFrame:
+            tsopSendingFrame = &tsopFrame;
+            tsopSendingFrame->load();
+            return tsopSendingFrame->next();
+
+        case SlaveCommand::tsopTrackFrame:
+            tsopSendingFrame = &tsopTrackingFrame;
+            tsopSendingFrame->load();
+            return tsopSendingFrame->next();
+
+        case SlaveCommand::tsopStartCalibration:
+            tsops.startCalibration();
+            return 0;
+
+        case SlaveCommand::tsopFinishCalibration:
+            tsops.finishCalibration();
+            return 0;
+
+        case SlaveCommand::tsopCancelCalibration:
+            tsops.cancelCalibration();
+            return 0;
+
+        default:
+            return tsopSendingFrame->next();
+    }
+}
+
+uint16_t Simulator::respondLight(uint16_t command) {
+    // Mirrors spi0_isr in slave_light
+    switch (command) {
+        case SlaveCommand::lineAngle:
+            return lightFrame.data(0);
+
+        case SlaveCommand::lineSize:
+            return lightFrame.data(1);
+
+        case SlaveCommand::lightSensorsFirst16Bit:
+            return lightSensorArray.getFirst16Bit();
+
+        case SlaveCommand::lightSensorsSecond16Bit:
+            return lightSensorArray.getSecond16Bit();
+
+        case SlaveCommand::snapshotFrame:
+            lightFrame.load();
+            return lightFrame.next();
+
+        default:
+            return lightFrame.next();
+    }
+}
+
+void Simulator::sampleGyro() {
+    if (!gyroFIFOEnabled) {
+        return;
+    }
+
+    int capacity = MPU9250_FIFO_SIZE / 2;
+
+    // A full FIFO overwrites its oldest sample
+    if (gyroFIFOCount == capacity) {
+        gyroFIFOStart = (gyroFIFOStart + 1) % capacity;
+        gyroFIFOCount--;
+    }
+
+    gyroFIFO[(gyroFIFOStart + gyroFIFOCount) % capacity] = gyroReading();
+    gyroFIFOCount++;
+}
+
+int16_t Simulator::gyroReading() {
+    // 1000 degrees/second full scale, z points up so clockwise is negative
+    double raw = -angularVelocity * 32768.0 / 1000.0 + SIMULATOR_GYRO_BIAS + SIMULATOR_GYRO_DRIFT * (now / 60000000.0);
+    raw += (randomDouble() * 2 - 1) * SIMULATOR_GYRO_NOISE;
+
+    return (int16_t)round(constrain(raw, -32768.0, 32767.0));
+}
+
+void Simulator::magReading(int16_t &x, int16_t &y) {
+    // The field in the robot's frame, x to the right and y forwards
+    double field = degreesToRadians(SIMULATOR_MAG_DIRECTION - heading);
+    double fieldX = SIMULATOR_MAG_FIELD * sin(field);
+    double fieldY = SIMULATOR_MAG_FIELD * cos(field);
+
+    x = (int16_t)round(fieldX * SIMULATOR_MAG_SCALE_X + SIMULATOR_MAG_OFFSET_X) + (int)(random() % (2 * SIMULATOR_MAG_NOISE + 1)) - SIMULATOR_MAG_NOISE;
+    y = (int16_t)round(fieldY * SIMULATOR_MAG_SCALE_Y + SIMULATOR_MAG_OFFSET_Y) + (int)(random() % (2 * SIMULATOR_MAG_NOISE + 1)) - SIMULATOR_MAG_NOISE;
+}
+
+void Simulator::buildPixyFrame() {
+    pixyWordCount = 0;
+    pixyByteIndex = 0;
+
+    addPixyBlock({0, SIMULATOR_FIELD_LENGTH / 2.0}, COLOUR_SIG_ATTACK);
+    addPixyBlock({0, -SIMULATOR_FIELD_LENGTH / 2.0}, COLOUR_SIG_DEFEND);
+
+    // A zero word ends the frame, two mean there are no blocks at all
+    pixyWords[pixyWordCount++] = 0;
+
+    if (pixyWordCount == 1) {
+        pixyWords[pixyWordCount++] = 0;
+    }
+}
+
+void Simulator::addPixyBlock(Vector2D goal, uint16_t signature) {
+    double dx = goal.x - robot.position.x;
+    double dy = goal.y - robot.position.y;
+    double distance = sqrt(dx * dx + dy * dy);
+    double angle = doubleMod(radiansToDegrees(atan2(dx, dy)) - heading + 180, 360) - 180;
+
+    if (fabs(angle) > PIXY_HORIZONTAL_FOV / 2.0 || distance == 0) {
+        return;
+    }
+
+    uint16_t x = (uint16_t)round(PIXY_FRAME_WIDTH / 2.0 + angle / (PIXY_HORIZONTAL_FOV / 2.0) * (PIXY_FRAME_WIDTH / 2.0));
+    uint16_t y = PIXY_FRAME_HEIGHT / 2;
+    uint16_t width = (uint16_t)round(2 * radiansToDegrees(atan(SIMULATOR_GOAL_WIDTH / 2.0 / distance)) / PIXY_HORIZONTAL_FOV * PIXY_FRAME_WIDTH);
+    uint16_t height = (uint16_t)round(radiansToDegrees(atan(SIMULATOR_GOAL_HEIGHT / distance)) / PIXY_VERTICAL_FOV * PIXY_FRAME_HEIGHT);
+
+    // Every block starts with a start word, the first one of a frame with two
+    if (pixyWordCount == 0) {
+        pixyWords[pixyWordCount++] = PIXY_START_WORD;
+    }
+
+    pixyWords[pixyWordCount++] = PIXY_START_WORD;
+    pixyWords[pixyWordCount++] = signature + x + y + width + height;
+    pixyWords[pixyWordCount++] = signature;
+    pixyWords[pixyWordCount++] = x;
+    pixyWords[pixyWordCount++] = y;
+    pixyWords[pixyWordCount++] = width;
+    pixyWords[pixyWordCount++] = height;
+}
+
+uint32_t Simulator::random() {
+    // xorshift32
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+
+    return randomState;
+}
+
+double Simulator::randomDouble() {
+    return random() / 4294967296.0;
+}
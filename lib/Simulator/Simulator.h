@@ -0,0 +1,337 @@
+/* Deterministic 2D field simulator for running the master on a PC.
+ *
+ * The simulator is a HALBackend with a virtual clock behind micros(). It
+ * simulates the robot, the ball, both goals, the white line and an opposing
+ * goalie, emulates both slaves by running the real TSOPArray and
+ * LightSensorArray code against synthetic sensor readings, answers the IMU
+ * and Pixy over I2C and drives the robot from the motor pins written by
+ * MotorArray. Linking the library into a native build installs it.
+ *
+ * All the SIMULATOR_ values below can be overridden with build flags, e.g.
+ * -D SIMULATOR_LOOP_TIME=5000 to see how a slower master loop plays.
+ */
+
+#ifndef SIMULATOR_H
+#define SIMULATOR_H
+
+#include <Arduino.h>
+#include <HAL.h>
+#include <Config.h>
+#include <Pins.h>
+#include <Common.h>
+#include <Slave.h>
+#include <TSOPArray.h>
+#include <BallTracker.h>
+#include <LightSensorArray.h>
+#include <PixyI2C.h>
+
+// Matches
+
+#ifndef SIMULATOR_MATCHES
+#define SIMULATOR_MATCHES 1
+#endif
+
+#ifndef SIMULATOR_MATCH_TIME
+#define SIMULATOR_MATCH_TIME 600000000
+#endif
+
+#ifndef SIMULATOR_SEED
+#define SIMULATOR_SEED 1
+#endif
+
+// Timing (all in microseconds)
+
+#ifndef SIMULATOR_LOOP_TIME
+#define SIMULATOR_LOOP_TIME 1000
+#endif
+
+#ifndef SIMULATOR_SPI_TRANSFER_TIME
+#define SIMULATOR_SPI_TRANSFER_TIME 15
+#endif
+
+#ifndef SIMULATOR_PHYSICS_STEP
+#define SIMULATOR_PHYSICS_STEP 1000
+#endif
+
+// The samples of a TSOP read plus the time to finish it
+#ifndef SIMULATOR_TSOP_FRAME_TIME
+#define SIMULATOR_TSOP_FRAME_TIME (TSOP_READ_SAMPLES * TSOP_SAMPLE_TIME + 76)
+#endif
+
+#ifndef SIMULATOR_LIGHT_FRAME_TIME
+#define SIMULATOR_LIGHT_FRAME_TIME 500
+#endif
+
+// Field (all in metres)
+
+#define SIMULATOR_FIELD_WIDTH 1.82
+#define SIMULATOR_FIELD_LENGTH 2.43
+#define SIMULATOR_OUTER_AREA 0.3
+#define SIMULATOR_LINE_WIDTH 0.05
+#define SIMULATOR_GOAL_WIDTH 0.6
+#define SIMULATOR_GOAL_HEIGHT 0.14
+
+// Robots and ball
+
+#define SIMULATOR_ROBOT_RADIUS 0.11
+#define SIMULATOR_WHEEL_RADIUS 0.09
+#define SIMULATOR_LS_RADIUS 0.07
+#define SIMULATOR_BALL_RADIUS 0.037
+
+#ifndef SIMULATOR_WHEEL_SPEED
+#define SIMULATOR_WHEEL_SPEED 2.0
+#endif
+
+#ifndef SIMULATOR_MOTOR_TIME_CONSTANT
+#define SIMULATOR_MOTOR_TIME_CONSTANT 0.05
+#endif
+
+// Most the wheels can accelerate the robot by in m/s^2 before slipping, 0
+// for wheels that never slip
+#ifndef SIMULATOR_TRACTION
+#define SIMULATOR_TRACTION 0
+#endif
+
+#define SIMULATOR_CAPTURE_ANGLE 30
+#define SIMULATOR_BALL_FRICTION_TIME 1.5
+#define SIMULATOR_BALL_MAX_SPEED 2.5
+
+#define SIMULATOR_PROGRESS_DISTANCE 0.1
+#define SIMULATOR_PROGRESS_TIME 10000000
+#define SIMULATOR_BALL_RESTITUTION 0.3
+#define SIMULATOR_WALL_RESTITUTION 0.5
+
+#ifndef SIMULATOR_OPPONENT_SPEED
+#define SIMULATOR_OPPONENT_SPEED 0.3
+#endif
+
+#define SIMULATOR_OPPONENT_KICK_SPEED 1.0
+
+// Sensors
+
+#define SIMULATOR_TSOP_PEAK 0.85
+#define SIMULATOR_TSOP_FALLOFF 1.5
+#define SIMULATOR_TSOP_AMBIENT 0.01
+
+// Each TSOP's sensitivity is up to this fraction away from nominal
+#ifndef SIMULATOR_TSOP_MISMATCH
+#define SIMULATOR_TSOP_MISMATCH 0
+#endif
+
+#define SIMULATOR_LS_GREEN 100
+#define SIMULATOR_LS_WHITE 300
+
+#ifndef SIMULATOR_LS_NOISE
+#define SIMULATOR_LS_NOISE 10
+#endif
+
+// Lighting is brighter by this fraction at the attacking end of the field
+// than at the defending end
+#ifndef SIMULATOR_LS_GRADIENT
+#define SIMULATOR_LS_GRADIENT 0
+#endif
+
+// Each light sensor's gain is up to this fraction away from nominal
+#ifndef SIMULATOR_LS_MISMATCH
+#define SIMULATOR_LS_MISMATCH 0
+#endif
+
+// Radius of the patch of floor each light sensor sees in metres, 0 for a point
+#ifndef SIMULATOR_LS_SPOT
+#define SIMULATOR_LS_SPOT 0
+#endif
+
+#ifndef SIMULATOR_GYRO_BIAS
+#define SIMULATOR_GYRO_BIAS 0
+#endif
+
+// Thermal drift of the bias in raw counts per minute
+#ifndef SIMULATOR_GYRO_DRIFT
+#define SIMULATOR_GYRO_DRIFT 0
+#endif
+
+#define SIMULATOR_GYRO_NOISE 4
+#define SIMULATOR_GYRO_SAMPLE_TIME 1000
+
+// Horizontal field in raw magnetometer counts and its direction clockwise
+// from the attacking goal, seen through the robot's hard and soft iron
+#define SIMULATOR_MAG_FIELD 150
+#define SIMULATOR_MAG_DIRECTION 40
+#define SIMULATOR_MAG_OFFSET_X 60
+#define SIMULATOR_MAG_OFFSET_Y -30
+#define SIMULATOR_MAG_SCALE_X 1.15
+#define SIMULATOR_MAG_SCALE_Y 0.9
+#define SIMULATOR_MAG_NOISE 3
+
+#define SIMULATOR_PIXY_WORDS 64
+
+enum SimulatorBoard: int {
+    masterBoard,
+    tsopBoard,
+    lightBoard
+};
+
+typedef struct SimulatorBody {
+    Vector2D position;
+    Vector2D velocity;
+} SimulatorBody;
+
+class Simulator: public HALBackend {
+public:
+    Simulator();
+
+    uint32_t micros();
+    void delayMicroseconds(uint32_t duration);
+
+    uint8_t digitalRead(uint8_t pin);
+    void digitalWrite(uint8_t pin, uint8_t value);
+    int analogRead(uint8_t pin);
+
+    uint16_t spiTransfer16(uint8_t cs, uint16_t data);
+
+    void i2cBegin(uint32_t rate);
+    uint8_t i2cWrite(uint8_t address, const uint8_t *data, uint8_t length);
+    uint8_t i2cRead(uint8_t address, uint8_t *data, uint8_t length);
+    uint32_t i2cRequest(uint8_t address, uint8_t *data, uint8_t length);
+
+    bool running();
+    void loopComplete();
+    void headingUpdated(double heading);
+
+private:
+    uint64_t now = 0;
+    uint64_t physicsTime = 0;
+    uint64_t matchStart = 0;
+    uint64_t nextTSOPFrame = 0;
+    uint64_t nextLightFrame = 0;
+
+    // The TSOP slave's clock, the end of the sub-frame it is working on
+    uint64_t tsopTime = 0;
+
+    SimulatorBoard board = SimulatorBoard::masterBoard;
+    uint32_t randomState = SIMULATOR_SEED;
+
+    // Robot, heading is in degrees clockwise from the attacking goal
+    SimulatorBody robot;
+    double heading = 0;
+    double angularVelocity = 0;
+    double wheelSpeeds[4] = {0};
+
+    // Last heading from the master's IMU
+    double imuHeading = 0;
+
+    SimulatorBody ball;
+    SimulatorBody opponent;
+
+    Vector2D progressPosition;
+    uint64_t progressTime = 0;
+
+    // Slaves
+    bool slavesInitialised = false;
+    TSOPArray tsops;
+    LightSensorArray lightSensorArray;
+    double tsopProbabilities[TSOP_NUM] = {0};
+    double tsopSensitivities[TSOP_NUM];
+    double lightSensorGains[LS_NUM];
+    uint32_t tsopsPowered = 0;
+    int tsopIndexes[HAL_NUM_PINS];
+    int lightSensorIndexes[HAL_NUM_PINS];
+    uint16_t tsopDataOut = 0;
+    uint16_t lightDataOut = 0;
+
+    // What each slave's ISR last pushed into its SPI transmit FIFO
+    uint16_t tsopDataPushed = 0;
+    uint16_t lightDataPushed = 0;
+    BallTracker tsopTracker;
+    SlaveFrame tsopFrame;
+    SlaveFrame tsopTrackingFrame;
+    SlaveFrame *tsopSendingFrame = &tsopFrame;
+    SlaveFrame lightFrame;
+
+    // I2C devices, a byte is 9 clocks
+    uint32_t i2cByteTime = 90;
+    uint8_t i2cRegisters[128] = {0};
+    bool gyroFIFOEnabled = false;
+    int16_t gyroFIFO[MPU9250_FIFO_SIZE / 2];
+    int gyroFIFOStart = 0;
+    int gyroFIFOCount = 0;
+    int gyroFIFOByte = 0;
+    uint64_t nextGyroSample = 0;
+    uint16_t pixyWords[SIMULATOR_PIXY_WORDS];
+    int pixyWordCount = 0;
+    int pixyByteIndex = 0;
+
+    // Statistics
+    int match = 0;
+    long loops = 0;
+    int goalsFor = 0;
+    int goalsAgainst = 0;
+    int lineOuts = 0;
+    int ballOuts = 0;
+    int lackOfProgress = 0;
+    bool robotWasOut = false;
+    uint64_t ballPlacedTime = 0;
+    bool ballReached = false;
+    double timeToBall = 0;
+    int ballsReached = 0;
+    double wheelSlip = 0;
+    int falseLines = 0;
+    int missedLines = 0;
+    int totalGoalsFor = 0;
+    int totalGoalsAgainst = 0;
+    int totalLineOuts = 0;
+    int totalBallOuts = 0;
+    int totalLackOfProgress = 0;
+    long totalLoops = 0;
+    double totalTimeToBall = 0;
+    int totalBallsReached = 0;
+    double totalWheelSlip = 0;
+    int totalFalseLines = 0;
+    int totalMissedLines = 0;
+
+    // Heading error each loop and how it follows the turn rate. The mean shows
+    // drift and the lag is the least squares fit of error = -lag * angularVelocity
+    double headingErrors = 0;
+    double headingSquares = 0;
+    double maxHeadingError = 0;
+    double headingErrorRate = 0;
+    double rateSquares = 0;
+    double totalHeadingErrors = 0;
+    double totalHeadingSquares = 0;
+    double totalMaxHeadingError = 0;
+    double totalHeadingErrorRate = 0;
+    double totalRateSquares = 0;
+
+    void advance(uint32_t duration);
+    void stepPhysics(double dt);
+    void kickOff();
+    void placeBallNeutral();
+    void finishMatch();
+
+    double motorSpeed(int pwm, int inOne, int inTwo, bool reversed);
+    void captureBall();
+    void collide(SimulatorBody &body, double radius, SimulatorBody &obstacle, double obstacleRadius, double kickSpeed);
+    void constrainToField(SimulatorBody &body, double radius, double restitution);
+    bool isOnWhite(Vector2D point);
+    Vector2D lightSensorPosition(int index);
+    double whiteFraction(Vector2D point);
+
+    void initialiseSlaves();
+    void updateTSOPSlave(uint64_t time);
+    void updateTSOPFrame();
+    void updateLightSlave();
+    uint16_t respondTSOP(uint16_t command);
+    uint16_t respondLight(uint16_t command);
+    void readI2CDevice(uint8_t address, uint8_t *data, uint8_t length);
+
+    int16_t gyroReading();
+    void sampleGyro();
+    void magReading(int16_t &x, int16_t &y);
+    void buildPixyFrame();
+    void addPixyBlock(Vector2D goal, uint16_t signature);
+
+    uint32_t random();
+    double randomDouble();
+};
+
+#endif // SIMULATOR_H
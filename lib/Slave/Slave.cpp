@@ -1,5 +1,87 @@
 #include "Slave.h"
 
+void SlaveFrame::publish(const uint16_t *data) {
+    // Fill the buffer the ISR isn't reading from, then make it the published one
+    int back = published ^ 1;
+    volatile uint16_t *frame = buffers[back];
+
+    sequence = (sequence + 1) & ((1 << SLAVE_FRAME_SEQUENCE_BITS) - 1);
+
+    for (int i = 0; i < SLAVE_FRAME_DATA_LENGTH; i++) {
+        frame[i] = data[i];
+    }
+
+    frame[SLAVE_FRAME_LENGTH - 1] = sequence << (16 - SLAVE_FRAME_SEQUENCE_BITS) | crc(sequence, frame, SLAVE_FRAME_DATA_LENGTH);
+
+    published = back;
+}
+
+void SlaveFrame::load() {
+    const volatile uint16_t *frame = buffers[published];
+
+    for (int i = 0; i < SLAVE_FRAME_LENGTH; i++) {
+        words[i] = frame[i];
+    }
+
+    index = 0;
+}
+
+uint16_t SlaveFrame::next() {
+    return index < SLAVE_FRAME_LENGTH ? words[index++] : 0;
+}
+
+uint16_t SlaveFrame::data(int i) {
+    return buffers[published][i];
+}
+
+void SlaveFrame::read(uint16_t *data) {
+    const volatile uint16_t *frame = buffers[published];
+
+    for (int i = 0; i < SLAVE_FRAME_DATA_LENGTH; i++) {
+        data[i] = frame[i];
+    }
+}
+
+bool SlaveFrame::unpack(const volatile uint16_t *burst, uint16_t &sequence, uint16_t *data) {
+    // The reply is delayed by the slave's pipeline
+    const volatile uint16_t *words = &burst[SLAVE_FRAME_OFFSET];
+    uint16_t check = words[SLAVE_FRAME_LENGTH - 1];
+    uint16_t frameSequence = check >> (16 - SLAVE_FRAME_SEQUENCE_BITS);
+
+    if (crc(frameSequence, words, SLAVE_FRAME_DATA_LENGTH) != (check & 0x0FFF)) {
+        return false;
+    }
+
+    sequence = frameSequence;
+
+    for (int i = 0; i < SLAVE_FRAME_DATA_LENGTH; i++) {
+        data[i] = words[i];
+    }
+
+    return true;
+}
+
+uint16_t SlaveFrame::crc(uint16_t sequence, const volatile uint16_t *words, int length) {
+    // CRC-12 (polynomial 0x80F) of the sequence and then each word, most significant bit first
+    uint16_t crc = 0x0FFF;
+
+    for (int i = -1; i < length; i++) {
+        uint16_t word = i < 0 ? sequence : words[i];
+        int bits = i < 0 ? SLAVE_FRAME_SEQUENCE_BITS : 16;
+
+        for (int bit = bits - 1; bit >= 0; bit--) {
+            bool feedback = ((word >> bit) ^ (crc >> 11)) & 1;
+            crc = (crc << 1) & 0x0FFF;
+
+            if (feedback) {
+                crc ^= 0x080F;
+            }
+        }
+    }
+
+    return crc;
+}
+
 void Slave::init(int csPin) {
     cs = csPin;
 
@@ -16,19 +98,46 @@ uint16_t Slave::transaction(SlaveCommand command) {
     return dataIn[0];
 }
 
+bool Slave::frameTransaction(uint16_t *data, SlaveCommand command) {
+    dataOut[0] = (uint16_t)command;
+
+    for (int i = 1; i < SLAVE_BURST_LENGTH; i++) {
+        dataOut[i] = SLAVE_FRAME_FILL;
+    }
+
+    spi.txrx16(dataOut, dataIn, SLAVE_BURST_LENGTH, CTAR_0, cs);
+
+    return SlaveFrame::unpack(dataIn, sequence, data);
+}
+
 void SlaveLightSensor::init() {
     Slave::init(MASTER_CS_LIGHT);
 }
 
+bool SlaveLightSensor::update() {
+    uint16_t data[SLAVE_FRAME_DATA_LENGTH];
+
+    // Keep the last good values if the frame was corrupted
+    if (!frameTransaction(data)) {
+        return false;
+    }
+
+    lineAngle = (double)data[0] / 100.0;
+    lineSize = (double)data[1] / 100.0;
+
+    return true;
+}
+
 double SlaveLightSensor::getLineAngle() {
-    return (double)transaction(SlaveCommand::lineAngle) / 100.0;
+    return lineAngle;
 }
 
 double SlaveLightSensor::getLineSize() {
-    return (double)transaction(SlaveCommand::lineSize) / 100.0;
+    return lineSize;
 }
 
 uint16_t SlaveLightSensor::getFirst16Bit() {
+    // Only the app shows the sensors, so they're left out of the frame
     return transaction(SlaveCommand::lightSensorsFirst16Bit);
 }
 
@@ -49,8 +158,65 @@ int SlaveTSOP::getTSOPStrength() {
 }
 
 BallData SlaveTSOP::getBallData() {
-    int angle = getTSOPAngle();
-    int strength = getTSOPStrength();
+    uint16_t data[SLAVE_FRAME_DATA_LENGTH];
+
+    // The tracked ball from the slave, keep the last good values if the frame was corrupted
+    if (frameTransaction(data, SlaveCommand::tsopTrackFrame)) {
+        ballData = unpackTrack(data);
+    }
+
+    return ballData;
+}
+
+BallData SlaveTSOP::getRawBallData() {
+    uint16_t data[SLAVE_FRAME_DATA_LENGTH];
+
+    // Angle and strength always come from the same TSOP read, keep the last good
+    // values if the frame was corrupted
+    if (frameTransaction(data)) {
+        int angle = data[0];
+        int strength = data[1];
+
+        rawBallData = BallData(angle, strength, angle != TSOP_NO_BALL);
+    }
+
+    return rawBallData;
+}
+
+void SlaveTSOP::startCalibration() {
+    transaction(SlaveCommand::tsopStartCalibration);
+}
+
+void SlaveTSOP::finishCalibration() {
+    transaction(SlaveCommand::tsopFinishCalibration);
+}
+
+void SlaveTSOP::cancelCalibration() {
+    transaction(SlaveCommand::tsopCancelCalibration);
+}
+
+void SlaveTSOP::packTrack(int angle, int strength, int angularVelocity, int range, uint16_t *data) {
+    uint64_t packed = (uint64_t)constrain(angle, 0, 511)
+        | (uint64_t)constrain(strength, 0, 2047) << 9
+        | (uint64_t)constrain(range, 0, 1023) << 20
+        | (uint64_t)(uint16_t)constrain(angularVelocity, INT16_MIN, INT16_MAX) << 30;
+
+    for (int i = 0; i < SLAVE_FRAME_DATA_LENGTH; i++) {
+        data[i] = (uint16_t)(packed >> (i * 16));
+    }
+}
+
+BallData SlaveTSOP::unpackTrack(const uint16_t *data) {
+    uint64_t packed = 0;
+
+    for (int i = 0; i < SLAVE_FRAME_DATA_LENGTH; i++) {
+        packed |= (uint64_t)data[i] << (i * 16);
+    }
+
+    int angle = packed & 511;
+    int strength = (packed >> 9) & 2047;
+    int range = (packed >> 20) & 1023;
+    int angularVelocity = (int16_t)(packed >> 30);
 
-    return BallData(angle, strength, angle != TSOP_NO_BALL);
+    return BallData(angle, strength, angle != TSOP_NO_BALL, angularVelocity, range);
 }
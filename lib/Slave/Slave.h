@@ -12,28 +12,76 @@ enum SlaveCommand: int {
     lightSensorsFirst16Bit,
     lightSensorsSecond16Bit,
     tsopAngle,
-    tsopStrength
+    tsopStrength,
+    snapshotFrame,
+    tsopTrackedAngle,
+    tsopAngularVelocity,
+    tsopRange,
+    tsopTrackFrame,
+    tsopStartCalibration,
+    tsopFinishCalibration,
+    tsopCancelCalibration
+};
+
+/* A snapshot of a slave's data sent in one burst after SlaveCommand::snapshotFrame.
+ *
+ * Words: SLAVE_FRAME_DATA_LENGTH data words and a check word, which holds the
+ * sequence number in its top SLAVE_FRAME_SEQUENCE_BITS and a CRC-12 of the
+ * sequence and data below it. The frame always starts SLAVE_FRAME_OFFSET
+ * words into the burst.
+ *
+ * The slave's loop publishes each new reading into the back buffer and then
+ * swaps the buffer index, so the ISR only ever sees complete snapshots. When
+ * the command arrives the ISR copies the published frame and answers each
+ * following word with the next word of that copy.
+ */
+class SlaveFrame {
+public:
+    void publish(const uint16_t *data);
+
+    void load();
+    uint16_t next();
+    uint16_t data(int i);
+    void read(uint16_t *data);
+
+    static bool unpack(const volatile uint16_t *burst, uint16_t &sequence, uint16_t *data);
+    static uint16_t crc(uint16_t sequence, const volatile uint16_t *words, int length);
+
+private:
+    volatile uint16_t buffers[2][SLAVE_FRAME_LENGTH] = {{0}};
+    volatile int published = 0;
+    uint16_t sequence = 0;
+
+    uint16_t words[SLAVE_FRAME_LENGTH] = {0};
+    int index = SLAVE_FRAME_LENGTH;
 };
 
 class Slave {
 public:
     void init(int csPin);
     uint16_t transaction(SlaveCommand command);
+    bool frameTransaction(uint16_t *data, SlaveCommand command = SlaveCommand::snapshotFrame);
+
+    uint16_t sequence = 0;
 
 private:
-    volatile uint16_t dataIn[1];
-    volatile uint16_t dataOut[1];
+    volatile uint16_t dataIn[SLAVE_BURST_LENGTH];
+    volatile uint16_t dataOut[SLAVE_BURST_LENGTH];
     int cs;
 };
 
 class SlaveLightSensor: public Slave {
 public:
     void init();
+    bool update();
     uint16_t getFirst16Bit();
     uint16_t getSecond16Bit();
     double getLineAngle();
     double getLineSize();
 
+private:
+    double lineAngle = NO_LINE_ANGLE;
+    double lineSize = NO_LINE_SIZE;
 };
 
 class SlaveTSOP: public Slave {
@@ -42,6 +90,19 @@ public:
     int getTSOPAngle();
     int getTSOPStrength();
     BallData getBallData();
+    BallData getRawBallData();
+    void startCalibration();
+    void finishCalibration();
+    void cancelCalibration();
+
+    // The tracked ball is packed into the frame's data words as a 9 bit angle,
+    // 11 bit strength, 10 bit range and 16 bit angular velocity
+    static void packTrack(int angle, int strength, int angularVelocity, int range, uint16_t *data);
+    static BallData unpackTrack(const uint16_t *data);
+
+private:
+    BallData ballData = BallData(TSOP_NO_BALL, 0, false);
+    BallData rawBallData = BallData(TSOP_NO_BALL, 0, false);
 };
 
 #endif // SLAVE_H
@@ -2,6 +2,88 @@
  */
 #include "TSOPArray.h"
 
+// Q12 sine and cosine of each TSOP's bearing, worked out at compile time
+typedef struct TSOPVectors {
+    int sin[TSOP_NUM];
+    int cos[TSOP_NUM];
+} TSOPVectors;
+
+constexpr double taylorSin(double x) {
+    while (x > M_PI) {
+        x -= 2 * M_PI;
+    }
+
+    while (x < -M_PI) {
+        x += 2 * M_PI;
+    }
+
+    double term = x;
+    double sum = x;
+
+    for (int n = 1; n < 12; n++) {
+        term *= -x * x / ((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+
+    return sum;
+}
+
+constexpr int toQ12(double x) {
+    return (int)(x * 4096 + (x < 0 ? -0.5 : 0.5));
+}
+
+constexpr TSOPVectors makeTSOPVectors() {
+    TSOPVectors vectors = {};
+
+    for (int i = 0; i < TSOP_NUM; i++) {
+        double bearing = 2 * M_PI * i / TSOP_NUM;
+
+        vectors.sin[i] = toQ12(taylorSin(bearing));
+        vectors.cos[i] = toQ12(taylorSin(bearing + M_PI / 2));
+    }
+
+    return vectors;
+}
+
+static constexpr TSOPVectors tsopVectors = makeTSOPVectors();
+
+static_assert(TSOP_LOOP_COUNT + 1 < (1 << TSOP_COUNTER_BITS), "TSOP_COUNTER_BITS is too small for TSOP_LOOP_COUNT");
+
+#if TSOP_SLIDING_WINDOW
+    static_assert((TSOP_LOOP_COUNT + 1) % TSOP_SUB_FRAMES == 0, "TSOP_SUB_FRAMES must divide TSOP_LOOP_COUNT + 1");
+#endif
+
+#ifndef NATIVE
+    // Port input register and bit of a pin, from the Teensy core
+    #define TSOP_PIN_PORT(pin) TSOP_PIN_PORT_(pin)
+    #define TSOP_PIN_PORT_(pin) (&CORE_PIN ## pin ## _PINREG)
+    #define TSOP_PIN_BIT(pin) TSOP_PIN_BIT_(pin)
+    #define TSOP_PIN_BIT_(pin) CORE_PIN ## pin ## _BIT
+
+    static volatile uint32_t *const tsopPinPorts[TSOP_NUM] = {
+        TSOP_PIN_PORT(TSOP_0), TSOP_PIN_PORT(TSOP_1), TSOP_PIN_PORT(TSOP_2), TSOP_PIN_PORT(TSOP_3),
+        TSOP_PIN_PORT(TSOP_4), TSOP_PIN_PORT(TSOP_5), TSOP_PIN_PORT(TSOP_6), TSOP_PIN_PORT(TSOP_7),
+        TSOP_PIN_PORT(TSOP_8), TSOP_PIN_PORT(TSOP_9), TSOP_PIN_PORT(TSOP_10), TSOP_PIN_PORT(TSOP_11),
+        TSOP_PIN_PORT(TSOP_12), TSOP_PIN_PORT(TSOP_13), TSOP_PIN_PORT(TSOP_14), TSOP_PIN_PORT(TSOP_15),
+        TSOP_PIN_PORT(TSOP_16), TSOP_PIN_PORT(TSOP_17), TSOP_PIN_PORT(TSOP_18), TSOP_PIN_PORT(TSOP_19),
+        TSOP_PIN_PORT(TSOP_20), TSOP_PIN_PORT(TSOP_21), TSOP_PIN_PORT(TSOP_22), TSOP_PIN_PORT(TSOP_23)
+    };
+
+    static const uint8_t tsopPinBits[TSOP_NUM] = {
+        TSOP_PIN_BIT(TSOP_0), TSOP_PIN_BIT(TSOP_1), TSOP_PIN_BIT(TSOP_2), TSOP_PIN_BIT(TSOP_3),
+        TSOP_PIN_BIT(TSOP_4), TSOP_PIN_BIT(TSOP_5), TSOP_PIN_BIT(TSOP_6), TSOP_PIN_BIT(TSOP_7),
+        TSOP_PIN_BIT(TSOP_8), TSOP_PIN_BIT(TSOP_9), TSOP_PIN_BIT(TSOP_10), TSOP_PIN_BIT(TSOP_11),
+        TSOP_PIN_BIT(TSOP_12), TSOP_PIN_BIT(TSOP_13), TSOP_PIN_BIT(TSOP_14), TSOP_PIN_BIT(TSOP_15),
+        TSOP_PIN_BIT(TSOP_16), TSOP_PIN_BIT(TSOP_17), TSOP_PIN_BIT(TSOP_18), TSOP_PIN_BIT(TSOP_19),
+        TSOP_PIN_BIT(TSOP_20), TSOP_PIN_BIT(TSOP_21), TSOP_PIN_BIT(TSOP_22), TSOP_PIN_BIT(TSOP_23)
+    };
+
+    static inline uint32_t rotateRight(uint32_t x, int n) {
+        // Compiles to a single ROR
+        return (x >> n) | (x << ((32 - n) & 31));
+    }
+#endif
+
 void TSOPArray::init() {
     // Set the correct pinmodes for all the TSOP pins
     pinMode(TSOP_PWR_1, OUTPUT);
@@ -13,34 +95,89 @@ void TSOPArray::init() {
         pinMode(TSOPPins[i], INPUT);
     }
 
-    // Set up scaled sin/cos tables
+    #ifndef NATIVE
+        // Find the distinct ports so each is only read once per sample, and group the
+        // TSOPs whose port bit rotates onto their sample bit by the same amount
+        for (int i = 0; i < TSOP_NUM; i++) {
+            int port = 0;
 
-    // double temp;
-    // double temp_angle;
-    //
-    // for (int i = 0; i < TSOP_NUM; i++){
-    //     // remember, angle = -bearing + 90 = -bearing + PI/2
-    //     // angle = i * 2 * PI / TSOP_COUNT
-    //     temp_angle = 1.5707963f - 6.283185307f * i / TSOP_NUM;
-    //
-    //     temp = cos(temp_angle) * 4095.0f;
-    //     scaledCos[i] = temp;
-    //
-    //     temp = sin(temp_angle) * 4095.0f;
-    //     scaledSin[i] = temp;
-    // }
+            while (port < portCount && ports[port] != tsopPinPorts[i]) {
+                port++;
+            }
+
+            if (port == portCount) {
+                ports[portCount] = tsopPinPorts[i];
+                portCount++;
+            }
+
+            uint8_t rotation = (tsopPinBits[i] - i) & 31;
+            int group = 0;
+
+            while (group < groupCount && (groupPorts[group] != port || groupRotations[group] != rotation)) {
+                group++;
+            }
+
+            if (group == groupCount) {
+                groupPorts[groupCount] = port;
+                groupMasks[groupCount] = 0;
+                groupRotations[groupCount] = rotation;
+                groupCount++;
+            }
+
+            groupMasks[group] |= (uint32_t)1 << tsopPinBits[i];
+        }
+    #endif
+
+    loadCalibration();
 
     on();
+
+    if (!detectPowerGroups()) {
+        // The unlock will mask whichever TSOPs Pins.h guesses are on each rail
+        Serial.println("TSOP power groups not detected, using the TSOP_PWR_x_TSOPS masks from Pins.h");
+    }
 }
 
 void TSOPArray::updateOnce() {
     // Read each TSOP once
-    for (int i = 0; i < TSOP_NUM; i++) {
-        tempValues[i] += digitalRead(TSOPPins[i]) ^ 1;
-    }
+    uint32_t sample = readSample();
+
+    #if TSOP_SWAR_COUNTERS
+        // Add the sample to all the counters at once
+        addToCounters<TSOP_COUNTER_BITS>(counterBits, sample);
+    #else
+        for (int i = 0; i < TSOP_NUM; i++) {
+            tempValues[i] += (sample >> i) & 1;
+        }
+    #endif
 
     tsopCounter++;
 }
+
+uint32_t TSOPArray::readSample() {
+    // Bit i is set if TSOP i sees IR (the TSOP outputs are active low)
+    uint32_t sample = 0;
+
+    #ifdef NATIVE
+        for (int i = 0; i < TSOP_NUM; i++) {
+            sample |= (uint32_t)(digitalRead(TSOPPins[i]) ^ 1) << i;
+        }
+    #else
+        uint32_t portValues[TSOP_NUM];
+
+        for (int i = 0; i < portCount; i++) {
+            portValues[i] = ~*ports[i];
+        }
+
+        // 15 groups instead of 24 single bits with the Teensy 3.5 pinout
+        for (int i = 0; i < groupCount; i++) {
+            sample |= rotateRight(portValues[groupPorts[i]] & groupMasks[i], groupRotations[i]);
+        }
+    #endif
+
+    return sample;
+}
+
 void TSOPArray::on() {
     // Turn the TSOPs on
     digitalWrite(TSOP_PWR_1, HIGH);
@@ -64,12 +201,108 @@ void TSOPArray::unlock() {
     on();
 }
 
+bool TSOPArray::detectPowerGroups() {
+    /* Find which TSOPs each power pin powers by turning the groups off one at a time, an unpowered TSOP's output reads low.
+     * A TSOP is in a group if it sees IR in every sample while the group is off and not in every sample while it is on.
+     * The masks from Pins.h are kept unless every TSOP is found in exactly one group
+     */
+    uint32_t detectedTSOPs[TSOP_POWER_GROUPS];
+    uint32_t allTSOPs = 0;
+    bool valid = true;
+
+    for (int group = 0; group < TSOP_POWER_GROUPS; group++) {
+        uint32_t offTSOPs = ~(uint32_t)0;
+        uint32_t onTSOPs = ~(uint32_t)0;
+
+        digitalWrite(powerPins[group], LOW);
+        delay(TSOP_UNLOCK_DELAY);
+
+        for (int i = 0; i < TSOP_DETECT_SAMPLES; i++) {
+            offTSOPs &= readSample();
+            delayMicroseconds(TSOP_SAMPLE_TIME);
+        }
+
+        digitalWrite(powerPins[group], HIGH);
+        delay(TSOP_UNLOCK_DELAY);
+
+        for (int i = 0; i < TSOP_DETECT_SAMPLES; i++) {
+            onTSOPs &= readSample();
+            delayMicroseconds(TSOP_SAMPLE_TIME);
+        }
+
+        detectedTSOPs[group] = offTSOPs & ~onTSOPs;
+
+        if (detectedTSOPs[group] == 0 || (detectedTSOPs[group] & allTSOPs) != 0) {
+            valid = false;
+        }
+
+        allTSOPs |= detectedTSOPs[group];
+    }
+
+    if (!valid || allTSOPs != ((uint32_t)1 << TSOP_NUM) - 1) {
+        return false;
+    }
+
+    for (int group = 0; group < TSOP_POWER_GROUPS; group++) {
+        powerGroupTSOPs[group] = detectedTSOPs[group];
+    }
+
+    return true;
+}
+
+void TSOPArray::updateUnlock() {
+    /* Non-blocking alternative to unlock() which turns the power groups off
+     * one after another, so the rest of the TSOPs keep seeing the ball
+     */
+    if (unlocking) {
+        if (unlockTimer.timeHasPassedNoUpdate()) {
+            digitalWrite(powerPins[unlockGroup], HIGH);
+            unlocking = false;
+
+            settlingTSOPs |= powerGroupTSOPs[unlockGroup];
+        }
+    } else {
+        unlockGroup = (unlockGroup + 1) % TSOP_POWER_GROUPS;
+
+        digitalWrite(powerPins[unlockGroup], LOW);
+        unlockTimer.update();
+        unlocking = true;
+
+        unlockedTSOPs |= powerGroupTSOPs[unlockGroup];
+    }
+}
+
 void TSOPArray::finishRead() {
-    // Complete a reading of the TSOPs after a certain amount of individual readings, TSOP values are now stored in the values array until the next complete read
-    tsopCounter = 0;
+    /* Complete a reading of the TSOPs after TSOP_READ_SAMPLES individual readings, TSOP values are now stored in the values array until the next complete read.
+     * With TSOP_SLIDING_WINDOW each read is a sub-frame and values holds the total of the last TSOP_SUB_FRAMES sub-frames,
+     * so it stays on the same scale as a full read
+     */
     for (int i = 0; i < TSOP_NUM; i++) {
+        #if TSOP_SWAR_COUNTERS
+            int value = counterValue<TSOP_COUNTER_BITS>(counterBits, i);
+        #else
+            int value = tempValues[i];
+            tempValues[i] = 0;
+        #endif
+
+        #if TSOP_SLIDING_WINDOW
+            // A TSOP that was off during this sub-frame repeats its last one
+            if ((unlockedTSOPs >> i) & 1) {
+                value = subFrameValues[mod(subFrame - 1, TSOP_SUB_FRAMES)][i];
+            }
+
+            windowValues[i] += value - subFrameValues[subFrame][i];
+            subFrameValues[subFrame][i] = value;
+            values[i] = windowValues[i];
+        #else
+            // A TSOP that was off during this read keeps its last value
+            if (!((unlockedTSOPs >> i) & 1)) {
+                values[i] = value;
+            }
+        #endif
+
         #if DEBUG_TSOP
-            Serial.print(tempValues[i]);
+            Serial.print(values[i]);
             if (i != TSOP_NUM - 1) {
                 Serial.print(", ");
             } else {
@@ -77,31 +310,142 @@ void TSOPArray::finishRead() {
             }
         #endif
 
-        values[i] = tempValues[i];
-        tempValues[i] = 0;
         filteredValues[i] = 0;
-        sortedFilteredValues[i] = 0;
-        indexes[i] = 0;
     }
 
+    #if TSOP_SWAR_COUNTERS
+        for (int j = 0; j < TSOP_COUNTER_BITS; j++) {
+            counterBits[j] = 0;
+        }
+    #endif
+
+    #if TSOP_SLIDING_WINDOW
+        subFrame = (subFrame + 1) % TSOP_SUB_FRAMES;
+    #endif
+
+    if (calibrating) {
+        for (int i = 0; i < TSOP_NUM; i++) {
+            calibrationSums[i] += values[i];
+            calibrationSquares[i] += values[i] * values[i];
+        }
+
+        calibrationReads++;
+    }
+
+    // The sampler stops once the counter is full, so this restarts it
+    tsopCounter = 0;
+
+    unlockedTSOPs = (unlocking ? powerGroupTSOPs[unlockGroup] : 0) | settlingTSOPs;
+    settlingTSOPs = 0;
+
     sortFilterValues();
     calculateAngleSimple();
-    calculateAngle(TSOP_BEST_TSOP_NO_ANGLE);
+    #if TSOP_VECTOR_ANGLE
+        calculateAngleVector();
+    #else
+        calculateAngle(TSOP_BEST_TSOP_NO_ANGLE);
+    #endif
     calculateStrengthSimple();
     calculateStrength(TSOP_BEST_TSOP_NO_STRENGTH);
 }
 
+void TSOPArray::loadCalibration() {
+    TSOPCalibration calibration;
+    EEPROM.get(TSOP_CALIBRATION_EEPROM, calibration);
+
+    // Without a stored calibration every TSOP is left as it is
+    bool valid = calibration.key == TSOP_CALIBRATION_KEY;
+
+    for (int i = 0; i < TSOP_NUM; i++) {
+        calibrationGains[i] = valid ? calibration.gains[i] : (1 << 12);
+
+        // Rounding is folded into the offset
+        calibrationOffsets[i] = (valid ? calibration.offsets[i] : 0) * (1 << 12) + (1 << 11);
+    }
+}
+
+void TSOPArray::startCalibration() {
+    for (int i = 0; i < TSOP_NUM; i++) {
+        calibrationSums[i] = 0;
+        calibrationSquares[i] = 0;
+    }
+
+    calibrationReads = 0;
+    calibrating = true;
+}
+
+void TSOPArray::cancelCalibration() {
+    // Keep the stored calibration rather than fitting to partial turns
+    calibrating = false;
+}
+
+bool TSOPArray::finishCalibration() {
+    /* Over whole turns every TSOP sees the ball from every angle, so they
+     * should all have the same mean and spread. Fit each TSOP's gain and offset
+     * to map its mean and standard deviation onto the average of all of them
+     */
+    calibrating = false;
+
+    if (calibrationReads == 0) {
+        return false;
+    }
+
+    double means[TSOP_NUM];
+    double deviations[TSOP_NUM];
+    double meanTotal = 0;
+    double deviationTotal = 0;
+
+    for (int i = 0; i < TSOP_NUM; i++) {
+        means[i] = (double)calibrationSums[i] / calibrationReads;
+        deviations[i] = sqrt(fmax((double)calibrationSquares[i] / calibrationReads - means[i] * means[i], 0));
+
+        // A TSOP that never changed is broken or was never pointed at the ball
+        if (deviations[i] < 1) {
+            return false;
+        }
+
+        meanTotal += means[i];
+        deviationTotal += deviations[i];
+    }
+
+    TSOPCalibration calibration;
+    calibration.key = TSOP_CALIBRATION_KEY;
+
+    for (int i = 0; i < TSOP_NUM; i++) {
+        double gain = deviationTotal / TSOP_NUM / deviations[i];
+
+        // Also keeps the Q12 gain inside an int16_t
+        if (gain < TSOP_CALIBRATION_MIN_GAIN || gain > TSOP_CALIBRATION_MAX_GAIN) {
+            return false;
+        }
+
+        calibration.gains[i] = (int16_t)round(gain * (1 << 12));
+        calibration.offsets[i] = (int16_t)round(meanTotal / TSOP_NUM - gain * means[i]);
+    }
+
+    EEPROM.put(TSOP_CALIBRATION_EEPROM, calibration);
+    loadCalibration();
+
+    return true;
+}
+
 void TSOPArray::sortFilterValues() {
     // Remove noise
     for (int i = 0; i < TSOP_NUM; i++) {
+        #if TSOP_CALIBRATION
+            int value = max((values[i] * calibrationGains[i] + calibrationOffsets[i]) >> 12, 0);
+        #else
+            int value = values[i];
+        #endif
+
         #if TSOP_FILTER_NOISE
-            if (values[i] < TSOP_MIN_IGNORE || values[i] > TSOP_MAX_IGNORE) {
+            if (value < TSOP_MIN_IGNORE || value > TSOP_MAX_IGNORE) {
                 tempFilteredValues[i] = 0;
             } else {
-                tempFilteredValues[i] = values[i];
+                tempFilteredValues[i] = value;
             }
         #else
-            tempFilteredValues[i] = values[i];
+            tempFilteredValues[i] = value;
         #endif
     }
 
@@ -117,26 +461,10 @@ void TSOPArray::sortFilterValues() {
         filteredValues[i] = temp >> 4;
     }
 
-    /* Sort the TSOP values from greatest to least in sortedFilteredValues
-     * and sort the TSOP indexes from greatest to least strength in indexes
+    /* Sort the best TSOP values from greatest to least in sortedFilteredValues
+     * and their TSOP indexes in indexes
      */
-    for (int i = 0; i < TSOP_NUM; i++) {
-        for (int j = 0; j < TSOP_NUM; j++) {
-            if (filteredValues[i] > sortedFilteredValues[j]) {
-                // We've found our place!
-                // Shift elements from index j down
-                if (j <= i) {
-                    // Make sure we only shift what is needed
-                    ARRAYSHIFTDOWN(sortedFilteredValues, j, i);
-                    ARRAYSHIFTDOWN(indexes, j, i);
-                }
-
-                sortedFilteredValues[j] = filteredValues[i];
-                indexes[j] = i;
-                break;
-            }
-        }
-    }
+    selectGreatest<TSOP_BEST_TSOP_NO, TSOP_NUM>(filteredValues, sortedFilteredValues, indexes);
 }
 
 void TSOPArray::calculateAngleSimple() {
@@ -152,37 +480,14 @@ void TSOPArray::calculateStrengthSimple() {
 }
 
 void TSOPArray::calculateAngle(int n) {
-    // Cartesian addition of best n TSOPs
-    // int x = 0;
-    // int y = 0;
-    // for (int i = 0; i < n; i++){
-    //     // convert vector to cartesian (remember that each bitshift << is *2)
-    //     x += sortedFilteredValues[i] * scaledCos[indexes[i]] >> 12;
-    //     y += sortedFilteredValues[i] * scaledSin[indexes[i]] >> 12;
-    // }
-    // if (x == 0 && y == 0){
-    //     // When vectors sum to (0, 0), we're in trouble. We've got some dodgy data
-    //     angle = 0;
-    // }
-    // else{
-    //     angle = 90 - (57.3 * atan2(y, x));
-    // }
-    //
-    // if (angle < 0){
-    //     angle += 360;
-    // }
-    // if (angle < 0){
-    //     angle += 360;
-    // }
-
     /* Averages the indexes of the best n TSOPs. Best TSOP is weighted
      * TSOP_FIRST_TSOP_WEIGHT and second is weighted TSOP_SECOND_TSOP_WEIGHT.
      * Rest are unweighted
      */
     int best = indexes[0];
-    int relIndexes[TSOP_NUM] = {0}; // indexes relative to best TSOP
+    int relIndexes[TSOP_BEST_TSOP_NO] = {0}; // indexes relative to best TSOP
 
-    for (int i = 0; i < TSOP_NUM; i++) {
+    for (int i = 0; i < n; i++) {
         relIndexes[i] = indexes[i] - best;
         if (relIndexes[i] < (1 - TSOP_NUM / 2)) {
             relIndexes[i] += TSOP_NUM;
@@ -204,7 +509,6 @@ void TSOPArray::calculateAngle(int n) {
 
     index = doubleMod(index, (double) TSOP_NUM);
 
-
     if (sortedFilteredValues[0] <= TSOP_MIN_IGNORE) {
         angle = -1;
     } else {
@@ -213,6 +517,26 @@ void TSOPArray::calculateAngle(int n) {
 
 }
 
+void TSOPArray::calculateAngleVector() {
+    /* Sum of all the TSOPs as vectors weighted by their filtered values. Using
+     * only the best few would pull the angle towards whichever side of the
+     * ball has more of them
+     */
+    int x = 0;
+    int y = 0;
+
+    for (int i = 0; i < TSOP_NUM; i++) {
+        x += filteredValues[i] * tsopVectors.sin[i];
+        y += filteredValues[i] * tsopVectors.cos[i];
+    }
+
+    if (sortedFilteredValues[0] <= TSOP_MIN_IGNORE) {
+        angle = -1;
+    } else {
+        angle = atan2Degrees(x, y);
+    }
+}
+
 void TSOPArray::calculateStrength(int n) {
     // Return average of strongest n TSOPs
     // could also have a limit, that is, only TSOPs > limit are averaged (team pi used 50)
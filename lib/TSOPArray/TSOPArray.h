@@ -9,19 +9,46 @@
 #include <Common.h>
 #include <Config.h>
 #include <Pins.h>
+#include <Timer.h>
+#include <EEPROM.h>
+
+// Only the best TSOPs are sorted
+#define TSOP_BEST_TSOP_NO (TSOP_BEST_TSOP_NO_ANGLE > TSOP_BEST_TSOP_NO_STRENGTH ? TSOP_BEST_TSOP_NO_ANGLE : TSOP_BEST_TSOP_NO_STRENGTH)
+
+// Samples to take before calling finishRead()
+#if TSOP_SLIDING_WINDOW
+    #define TSOP_READ_SAMPLES ((TSOP_LOOP_COUNT + 1) / TSOP_SUB_FRAMES)
+#else
+    #define TSOP_READ_SAMPLES (TSOP_LOOP_COUNT + 1)
+#endif
+
+// How the calibration is stored in EEPROM, gains are Q12
+typedef struct TSOPCalibration {
+    uint16_t key;
+    int16_t gains[TSOP_NUM];
+    int16_t offsets[TSOP_NUM];
+} TSOPCalibration;
 
 class TSOPArray {
 public:
     TSOPArray() {}
     void init();
     void updateOnce();
+    uint32_t readSample();
     void on();
     void off();
     void unlock();
+    bool detectPowerGroups();
+    void updateUnlock();
     void finishRead();
+    void loadCalibration();
+    void startCalibration();
+    bool finishCalibration();
+    void cancelCalibration();
     void sortFilterValues();
     void calculateAngleSimple();
     void calculateAngle(int n);
+    void calculateAngleVector();
     void calculateStrengthSimple();
     void calculateStrength(int n);
     int getAngle();
@@ -30,9 +57,9 @@ public:
 
     int values[TSOP_NUM] = {0};
     int filteredValues[TSOP_NUM] = {0};
-    int sortedFilteredValues[TSOP_NUM] = {0};
-    int indexes[TSOP_NUM] = {0};
-    int tsopCounter = 0;
+    int sortedFilteredValues[TSOP_BEST_TSOP_NO] = {0};
+    int indexes[TSOP_BEST_TSOP_NO] = {0};
+    volatile int tsopCounter = 0;
 
 private:
     int angle = 0;
@@ -41,10 +68,54 @@ private:
     int simpleStrength = 0;
 
     int tempValues[TSOP_NUM] = {0};
+
+    // Bit i of counterBits[j] is bit j of TSOP i's count
+    uint32_t counterBits[TSOP_COUNTER_BITS] = {0};
     int tempFilteredValues[TSOP_NUM] = {0};
+
+    // Calibrated value = (value * calibrationGains + calibrationOffsets) >> 12
+    int calibrationGains[TSOP_NUM];
+    int calibrationOffsets[TSOP_NUM];
+
+    // Sums of every read while calibrating
+    bool calibrating = false;
+    uint32_t calibrationReads = 0;
+    uint32_t calibrationSums[TSOP_NUM] = {0};
+    uint64_t calibrationSquares[TSOP_NUM] = {0};
+
+    #if TSOP_SLIDING_WINDOW
+        // Counts of the last TSOP_SUB_FRAMES sub-frames and their running total
+        int subFrameValues[TSOP_SUB_FRAMES][TSOP_NUM] = {{0}};
+        int windowValues[TSOP_NUM] = {0};
+        int subFrame = 0;
+    #endif
+
+    // Staggered unlocking, one power group is off at a time
+    int powerPins[TSOP_POWER_GROUPS] = {TSOP_PWR_1, TSOP_PWR_2, TSOP_PWR_3, TSOP_PWR_4};
+    uint32_t powerGroupTSOPs[TSOP_POWER_GROUPS] = {TSOP_PWR_1_TSOPS, TSOP_PWR_2_TSOPS, TSOP_PWR_3_TSOPS, TSOP_PWR_4_TSOPS};
+    int unlockGroup = TSOP_POWER_GROUPS - 1;
+    bool unlocking = false;
+    Timer unlockTimer = Timer(TSOP_UNLOCK_DELAY * 1000);
+
+    // TSOPs that were off at some point during the current read
+    uint32_t unlockedTSOPs = 0;
+
+    // TSOPs powered back on during the current read, masked for the next one too while they settle
+    uint32_t settlingTSOPs = 0;
+
     int TSOPPins[TSOP_NUM] = {TSOP_0, TSOP_1, TSOP_2, TSOP_3, TSOP_4, TSOP_5, TSOP_6, TSOP_7, TSOP_8, TSOP_9, TSOP_10, TSOP_11, TSOP_12, TSOP_13, TSOP_14, TSOP_15, TSOP_16, TSOP_17, TSOP_18, TSOP_19, TSOP_20, TSOP_21, TSOP_22, TSOP_23};
-    // int scaledSin[TSOP_NUM] = {0};
-    // int scaledCos[TSOP_NUM] = {0};
+
+    #ifndef NATIVE
+        // The GPIO ports the TSOPs are on
+        volatile uint32_t *ports[TSOP_NUM];
+        int portCount = 0;
+
+        // TSOPs on the same port that rotate by the same amount into the sample, copied with one mask
+        uint8_t groupPorts[TSOP_NUM];
+        uint32_t groupMasks[TSOP_NUM];
+        uint8_t groupRotations[TSOP_NUM];
+        int groupCount = 0;
+    #endif
 };
 
 #endif // TSOP_ARRAY_H
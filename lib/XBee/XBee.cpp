@@ -57,11 +57,13 @@ void XBee::receive() {
             otherIsOnField = (bool) dataBuffer[7];
 
             nothingRecieved = false;
+            anythingRecieved = true;
             connectedTimer.update();
         }
     }
 
-    isConnected = !nothingRecieved || !connectedTimer.timeHasPassedNoUpdate();
+    // The timer started at power on, not when the other robot was last heard
+    isConnected = !nothingRecieved || (anythingRecieved && !connectedTimer.timeHasPassedNoUpdate());
 
     if (!isConnected) {
         resetOtherData();
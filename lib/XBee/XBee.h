@@ -30,6 +30,7 @@ private:
     bool thisIsOnField;
 
     Timer connectedTimer = Timer(XBEE_LOST_COMMUNICATION_TIME);
+    bool anythingRecieved = false;
 
     void send();
     void receive();
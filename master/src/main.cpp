@@ -28,6 +28,7 @@
 #include <MovingAverage.h>
 #include <EEPROM.h>
 #include <PID.h>
+#include <Profiler.h>
 
 XBee xbee;
 T3SPI spi;
@@ -63,6 +64,16 @@ PID centreDistancePID(CENTRE_DISTANCE_KP, CENTRE_DISTANCE_KI, CENTRE_DISTANCE_KD
 PID centreSidewaysPID(CENTRE_SIDEWAYS_KP, CENTRE_SIDEWAYS_KI, CENTRE_SIDEWAYS_KD);
 PID defendSidewaysPID(DEFEND_SIDEWAYS_KP, DEFEND_SIDEWAYS_KI, DEFEND_SIDEWAYS_KD, DEFEND_SIDEWAYS_MAX_SPEED);
 
+ProfilerStage loopStage("loop");
+ProfilerStage tsopStage("tsop");
+ProfilerStage lightStage("light");
+ProfilerStage imuStage("imu");
+ProfilerStage pixyStage("pixy");
+ProfilerStage xbeeStage("xbee");
+ProfilerStage movementStage("movement");
+ProfilerStage motorStage("motors");
+ProfilerStage debugStage("debug");
+
 double facingDirection = 0;
 bool facingGoal = false;
 
@@ -85,7 +96,7 @@ void setup() {
     debug.init();
 
     // I2C
-    Wire.begin(I2C_MASTER, 0x00, I2C_PINS_18_19, I2C_PULLUP_EXT, 100000);
+    Wire.begin(I2C_MASTER, 0x00, I2C_PINS_18_19, I2C_PULLUP_EXT, I2C_RATE, I2C_OP_MODE_DMA);
     Wire.setDefaultTimeout(200000);
 
     debug.toggleOrange(true);
@@ -127,6 +138,9 @@ void setup() {
     debug.toggleAllLEDs(false);
 
     robotId = EEPROM.read(ROBOT_ID_EEPROM);
+
+    // Profiler
+    Profiler::init();
 }
 
 PlayMode currentPlayMode() {
@@ -154,10 +168,12 @@ void calculateLineAvoid() {
         if (lineData.size > LINE_BIG_SIZE) {
             moveData.angle = mod(lineData.angle + 180 - imu.heading, 360);
             moveData.speed = lineData.size == 3 ? OVER_LINE_SPEED : min(lineData.size / 2.0 * LINE_SPEED * 5, LINE_SPEED);
+            moveData.immediate = true;
         } else if (lineData.size > LINE_SMALL_SIZE) {
             if (isOutsideLine(moveData.angle)) {
                 moveData.angle = 0;
                 moveData.speed = 0;
+                moveData.immediate = true;
             }
         }
     }
@@ -184,25 +200,28 @@ void centre(double distance) {
 void calculateOrbit() {
     moveData.speed = ORBIT_SPEED;
 
-    if (angleIsInside(360 - ORBIT_SMALL_ANGLE, ORBIT_SMALL_ANGLE, ballData.angle)) {
-        moveData.angle = (int)round(ballData.angle < 180 ? (ballData.angle * ORBIT_BALL_FORWARD_ANGLE_TIGHTENER) : (360 - (360 - ballData.angle) * ORBIT_BALL_FORWARD_ANGLE_TIGHTENER));
-    } else if (angleIsInside(360 - ORBIT_BIG_ANGLE, ORBIT_BIG_ANGLE, ballData.angle)) {
-        if (ballData.angle < 180) {
-            double nearFactor = (double)(ballData.angle - ORBIT_SMALL_ANGLE) / (double)(ORBIT_BIG_ANGLE - ORBIT_SMALL_ANGLE);
-            moveData.angle = (int)round(90 * nearFactor + ballData.angle * ORBIT_BALL_FORWARD_ANGLE_TIGHTENER + ballData.angle * (1 - ORBIT_BALL_FORWARD_ANGLE_TIGHTENER) * nearFactor);
+    // Aim for where the ball will be rather than where it was last seen
+    int ballAngle = mod(ballData.angle + (int)round(ballData.angularVelocity * ORBIT_LEAD_TIME), 360);
+
+    if (angleIsInside(360 - ORBIT_SMALL_ANGLE, ORBIT_SMALL_ANGLE, ballAngle)) {
+        moveData.angle = (int)round(ballAngle < 180 ? (ballAngle * ORBIT_BALL_FORWARD_ANGLE_TIGHTENER) : (360 - (360 - ballAngle) * ORBIT_BALL_FORWARD_ANGLE_TIGHTENER));
+    } else if (angleIsInside(360 - ORBIT_BIG_ANGLE, ORBIT_BIG_ANGLE, ballAngle)) {
+        if (ballAngle < 180) {
+            double nearFactor = (double)(ballAngle - ORBIT_SMALL_ANGLE) / (double)(ORBIT_BIG_ANGLE - ORBIT_SMALL_ANGLE);
+            moveData.angle = (int)round(90 * nearFactor + ballAngle * ORBIT_BALL_FORWARD_ANGLE_TIGHTENER + ballAngle * (1 - ORBIT_BALL_FORWARD_ANGLE_TIGHTENER) * nearFactor);
         } else {
-            double nearFactor = (double)(360 - ballData.angle - ORBIT_SMALL_ANGLE) / (double)(ORBIT_BIG_ANGLE - ORBIT_SMALL_ANGLE);
-            moveData.angle = (int)round(360 - (90 * nearFactor + (360 - ballData.angle) * ORBIT_BALL_FORWARD_ANGLE_TIGHTENER + (360 - ballData.angle) * (1 - ORBIT_BALL_FORWARD_ANGLE_TIGHTENER) * nearFactor));
+            double nearFactor = (double)(360 - ballAngle - ORBIT_SMALL_ANGLE) / (double)(ORBIT_BIG_ANGLE - ORBIT_SMALL_ANGLE);
+            moveData.angle = (int)round(360 - (90 * nearFactor + (360 - ballAngle) * ORBIT_BALL_FORWARD_ANGLE_TIGHTENER + (360 - ballAngle) * (1 - ORBIT_BALL_FORWARD_ANGLE_TIGHTENER) * nearFactor));
         }
     } else {
         if (ballData.strength > ORBIT_SHORT_STRENGTH) {
-            moveData.angle = ballData.angle + (ballData.angle < 180 ? 90 : -90);
+            moveData.angle = ballAngle + (ballAngle < 180 ? 90 : -90);
         } else if (ballData.strength > ORBIT_BIG_STRENGTH) {
             double strengthFactor = (double)(ballData.strength - ORBIT_BIG_STRENGTH) / (double)(ORBIT_SHORT_STRENGTH - ORBIT_BIG_STRENGTH);
             double angleFactor = strengthFactor * 90;
-            moveData.angle = ballData.angle + (ballData.angle < 180 ? angleFactor : -angleFactor);
+            moveData.angle = ballAngle + (ballAngle < 180 ? angleFactor : -angleFactor);
         } else {
-            moveData.angle = ballData.angle;
+            moveData.angle = ballAngle;
         }
     }
 }
@@ -276,6 +295,8 @@ void calculateGoalTracking() {
 }
 
 void calculateMovement() {
+    moveData.immediate = false;
+
     if (currentPlayMode() == PlayMode::attack) {
         if (xbee.otherBallIsOut) {
             attackingBackwards = false;
@@ -519,28 +540,142 @@ void appDebug() {
     #endif
 }
 
+void updateProfiler(int command, int bluetoothCommand) {
+    // Print on request over Serial or Bluetooth, then start a fresh window
+    if (command == PROFILER_DUMP_COMMAND) {
+        Serial.println(Profiler::summary());
+        Profiler::reset();
+    }
+
+    if (bluetoothCommand == PROFILER_DUMP_COMMAND) {
+        debug.appSendProfile(Profiler::summary());
+        Profiler::reset();
+    }
+}
+
+bool spinOnTheSpot(int turns) {
+    // Gives up if the turns take too long, e.g. the robot is held or the IMU is dead
+    imu.motorsIdle = false;
+
+    double turned = 0;
+    double previousHeading = imu.heading;
+
+    Timer timeout(turns * CALIBRATION_TURN_TIMEOUT);
+    timeout.update();
+
+    while (turned < turns * 360 && !timeout.timeHasPassedNoUpdate()) {
+        motors.move(0, CALIBRATION_ROTATION, 0);
+
+        imu.update();
+        turned += doubleAbs(doubleMod(imu.heading - previousHeading + 180, 360) - 180);
+        previousHeading = imu.heading;
+    }
+
+    motors.brake();
+
+    return turned >= turns * 360;
+}
+
+void calibrateTSOPs() {
+    // Spin on the spot next to a stationary ball so every TSOP sees it from every angle
+    slaveTSOP.startCalibration();
+
+    if (spinOnTheSpot(TSOP_CALIBRATION_TURNS)) {
+        slaveTSOP.finishCalibration();
+    } else {
+        slaveTSOP.cancelCalibration();
+    }
+}
+
+void calibrateMagnetometer() {
+    // Spin on the spot where the robot will play so the field is measured in every direction
+    imu.startMagCalibration();
+
+    if (spinOnTheSpot(IMU_MAG_CALIBRATION_TURNS)) {
+        imu.finishMagCalibration();
+    } else {
+        imu.cancelMagCalibration();
+    }
+}
+
+void updateCommands() {
+    int command = Serial.available() ? Serial.read() : -1;
+    int bluetoothCommand = Bluetooth::receiveCommand();
+
+    #if PROFILER_ENABLED
+        updateProfiler(command, bluetoothCommand);
+    #endif
+
+    if (command == TSOP_CALIBRATION_COMMAND || bluetoothCommand == TSOP_CALIBRATION_COMMAND) {
+        calibrateTSOPs();
+    }
+
+    if (command == IMU_MAG_CALIBRATION_COMMAND || bluetoothCommand == IMU_MAG_CALIBRATION_COMMAND) {
+        calibrateMagnetometer();
+    }
+}
+
 void loop() {
-    ballData = slaveTSOP.getBallData();
-    switchingStrengthAverage.update(ballData.strength);
+    updateCommands();
+
+    PROFILE(loopStage);
+
+    {
+        PROFILE(tsopStage);
+
+        ballData = slaveTSOP.getBallData();
+        switchingStrengthAverage.update(ballData.strength);
+    }
 
     debug.toggleOrange(ballData.visible);
 
-    updateLine(slaveLightSensor.getLineAngle(), slaveLightSensor.getLineSize());
+    {
+        PROFILE(lightStage);
 
-    imu.update();
+        slaveLightSensor.update();
+        updateLine(slaveLightSensor.getLineAngle(), slaveLightSensor.getLineSize());
+    }
+
+    {
+        PROFILE(imuStage);
+
+        // The samples are from while the motors ran the last loop's movement
+        imu.motorsIdle = moveData.speed == 0 && abs(moveData.rotation) <= IMU_BIAS_MAX_ROTATION;
+        imu.update();
+    }
 
     #if PIXY_ENABLED
-        updatePixy();
-        calculateGoalTracking();
+        {
+            PROFILE(pixyStage);
+
+            updatePixy();
+            calculateGoalTracking();
+        }
     #endif
 
+    // The gyro is read in the background and collected by the next imu.update(),
+    // after the Pixy so they never share the bus
+    imu.requestGyroscope();
+
     #if XBEE_ENABLED
-        updateXBee();
+        {
+            PROFILE(xbeeStage);
+
+            updateXBee();
+        }
     #endif
 
-    calculateMovement();
+    {
+        PROFILE(movementStage);
+
+        calculateMovement();
+    }
+
+    {
+        PROFILE(motorStage);
 
-    motors.move(moveData);
+        motors.move(moveData);
+    }
 
     if (ledTimer.timeHasPassed()) {
         digitalWrite(LED_BUILTIN, ledOn);
@@ -552,6 +687,8 @@ void loop() {
     debug.toggleWhite(playMode == PlayMode::undecided);
 
     #if DEBUG_APP
+        PROFILE(debugStage);
+
         appDebug();
     #endif
 }
@@ -0,0 +1,259 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <IMU.h>
+#include <random>
+
+// Loop time of the robot, each gyro read takes one loop
+#define LOOP_TIME 1500
+
+// Gyro noise with the 92 Hz low pass (counts, about 0.1 degrees/second)
+#define GYRO_NOISE 3.0
+
+#define COUNTS_PER_DEGREE (32768.0 / 1000.0)
+
+/* An MPU9250 whose FIFO fills with gyro Z samples every IMU_SAMPLE_TIME. The
+ * bias drifts linearly and the robot turns at rate (degrees/second,
+ * clockwise), the clock moves on a loop with every read
+ */
+class GyroBackend: public HALBackend {
+public:
+    double bias = 0;
+    double biasDrift = 0;
+    double rate = 0;
+    double truthHeading = 0;
+
+    uint32_t micros() {
+        return now;
+    }
+
+    void delayMicroseconds(uint32_t duration) {
+        advance(duration);
+    }
+
+    uint8_t i2cWrite(uint8_t address, const uint8_t *data, uint8_t length) {
+        if (address == MPU9250_ADDRESS && length > 0) {
+            reg = data[0];
+
+            // FIFO reset
+            if (reg == 0x6A && length > 1 && (data[1] & 0x04)) {
+                fifoLength = 0;
+            }
+        }
+
+        return 0;
+    }
+
+    uint8_t i2cRead(uint8_t address, uint8_t *data, uint8_t length) {
+        memset(data, 0, length);
+
+        if (address != MPU9250_ADDRESS) {
+            return length;
+        }
+
+        if (reg == MPU9250_FIFO_COUNT && length >= 2) {
+            data[0] = (fifoLength * 2) >> 8;
+            data[1] = (fifoLength * 2) & 0xFF;
+        } else if (reg == MPU9250_FIFO_DATA) {
+            int samples = min(length / 2, fifoLength);
+
+            for (int i = 0; i < samples; i++) {
+                data[i * 2] = (uint16_t)fifo[i] >> 8;
+                data[i * 2 + 1] = (uint16_t)fifo[i] & 0xFF;
+            }
+
+            memmove(fifo, fifo + samples, (fifoLength - samples) * sizeof(int16_t));
+            fifoLength -= samples;
+        }
+
+        return length;
+    }
+
+    uint32_t i2cRequest(uint8_t address, uint8_t *data, uint8_t length) {
+        advance(LOOP_TIME);
+        i2cRead(address, data, length);
+        return now;
+    }
+
+    // Runs the robot's loop for a while, returns how far the heading moved
+    double run(IMU &imu, double seconds) {
+        double startHeading = imu.heading;
+        uint32_t startTime = now;
+
+        while (now - startTime < seconds * 1000000) {
+            imu.update();
+        }
+
+        return imu.heading - startHeading;
+    }
+
+private:
+    uint32_t now = 0;
+    uint32_t nextSample = 0;
+    uint8_t reg = 0;
+
+    int16_t fifo[MPU9250_FIFO_SIZE / 2];
+    int fifoLength = 0;
+
+    std::mt19937 random = std::mt19937(1);
+    std::normal_distribution<double> noise = std::normal_distribution<double>(0, GYRO_NOISE);
+
+    void advance(uint32_t duration) {
+        now += duration;
+
+        while ((int32_t)(now - nextSample) >= 0) {
+            bias += biasDrift * IMU_SAMPLE_TIME / 1000000.0;
+            truthHeading += rate * IMU_SAMPLE_TIME / 1000000.0;
+
+            // Turning clockwise reads negative, like the real gyro
+            double reading = (bias - rate) * COUNTS_PER_DEGREE + noise(random);
+
+            // The oldest sample is overwritten once the FIFO is full
+            if (fifoLength == MPU9250_FIFO_SIZE / 2) {
+                memmove(fifo, fifo + 1, (fifoLength - 1) * sizeof(int16_t));
+                fifoLength--;
+            }
+
+            fifo[fifoLength++] = (int16_t)round(reading);
+            nextSample += IMU_SAMPLE_TIME;
+        }
+    }
+};
+
+static double headingChange(double heading) {
+    return doubleMod(heading + 540, 360) - 180;
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_learns_constant_bias() {
+    GyroBackend backend;
+    backend.bias = 1.0;
+    HAL::setBackend(&backend);
+
+    IMU imu;
+    imu.init();
+    imu.calibrate();
+    imu.motorsIdle = true;
+
+    // Give the bias a few windows to settle
+    backend.run(imu, 2);
+
+    double drift = headingChange(backend.run(imu, 20));
+
+    char message[100];
+    sprintf(message, "Constant 1 deg/s bias: %.3f deg drift over 20 s", drift);
+    TEST_MESSAGE(message);
+
+    // An unlearnt bias would drift 20 degrees
+    TEST_ASSERT_FLOAT_WITHIN(0.2, 0.0, drift);
+}
+
+void test_tracks_drifting_bias() {
+    GyroBackend backend;
+    backend.bias = 1.0;
+    HAL::setBackend(&backend);
+
+    IMU imu;
+    imu.init();
+    imu.calibrate();
+    imu.motorsIdle = true;
+
+    // Warming up, the bias moves 0.3 deg/s a minute
+    backend.biasDrift = 0.3 / 60;
+
+    double worstDrift = 0;
+
+    for (int i = 0; i < 12; i++) {
+        double drift = headingChange(backend.run(imu, 10));
+        worstDrift = fmax(worstDrift, fabs(drift));
+    }
+
+    char message[100];
+    sprintf(message, "Bias drifting 0.3 deg/s a minute: worst %.3f deg drift per 10 s, bias now %.2f deg/s", worstDrift, backend.bias);
+    TEST_MESSAGE(message);
+
+    // Keeping the calibration bias would drift 15 degrees in the last 10 s
+    TEST_ASSERT_FLOAT_WITHIN(0.2, 0.0, worstDrift);
+}
+
+void test_ignores_turns_while_idle() {
+    GyroBackend backend;
+    backend.bias = 1.0;
+    HAL::setBackend(&backend);
+
+    IMU imu;
+    imu.init();
+    imu.calibrate();
+    imu.motorsIdle = true;
+    backend.run(imu, 2);
+
+    // Pushed round by another robot with the motors idle, then coasting to a stop
+    double startHeading = imu.heading;
+    double startTruth = backend.truthHeading;
+
+    backend.rate = 90;
+    backend.run(imu, 1);
+
+    for (int i = 0; i < 300; i++) {
+        backend.rate *= 0.98;
+        backend.run(imu, 0.01);
+    }
+
+    backend.rate = 0;
+    backend.run(imu, 0.1);
+
+    double turn = headingChange(imu.heading - startHeading);
+    double truthTurn = backend.truthHeading - startTruth;
+
+    double drift = headingChange(backend.run(imu, 10));
+
+    char message[120];
+    sprintf(message, "Pushed %.1f deg: measured %.2f deg, then %.3f deg drift over 10 s", truthTurn, turn, drift);
+    TEST_MESSAGE(message);
+
+    // Learning the turn or the coast as bias would throw both of these out
+    TEST_ASSERT_FLOAT_WITHIN(0.5, truthTurn, turn);
+    TEST_ASSERT_FLOAT_WITHIN(0.2, 0.0, drift);
+}
+
+void test_moving_not_learnt() {
+    GyroBackend backend;
+    backend.bias = 1.0;
+    HAL::setBackend(&backend);
+
+    IMU imu;
+    imu.init();
+    imu.calibrate();
+
+    // Driving about with the bias changing, nothing should be learnt then
+    imu.motorsIdle = false;
+    backend.biasDrift = 0.3 / 60;
+    backend.run(imu, 60);
+    backend.biasDrift = 0;
+
+    double startTruth = backend.truthHeading;
+    double drift = headingChange(backend.run(imu, 1));
+
+    // Still tracking the old bias, so the 0.3 deg/s change shows
+    TEST_ASSERT_FLOAT_WITHIN(0.05, -0.3, drift - (backend.truthHeading - startTruth));
+
+    // Once stopped it is relearnt
+    imu.motorsIdle = true;
+    backend.run(imu, 3);
+    drift = headingChange(backend.run(imu, 10));
+
+    TEST_ASSERT_FLOAT_WITHIN(0.2, 0.0, drift);
+}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(test_learns_constant_bias);
+    RUN_TEST(test_tracks_drifting_bias);
+    RUN_TEST(test_ignores_turns_while_idle);
+    RUN_TEST(test_moving_not_learnt);
+    exit(UNITY_END());
+}
+
+void loop() {}
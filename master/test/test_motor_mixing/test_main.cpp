@@ -0,0 +1,122 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <MotorArray.h>
+
+/* The double precision mixing the Q14 matrix replaced, with its rescale
+ * working (it used to be shadowed and never took effect). Speeds are for
+ * the right, left, back right and back left wheels
+ */
+static void doubleMixing(int angle, int rotation, int speed, int *speeds) {
+    angle = mod(90 - angle, 360);
+
+    double a = cos(degreesToRadians(angle)) / sin(degreesToRadians(MOTOR_ANGLE));
+    double b = sin(degreesToRadians(angle)) / cos(degreesToRadians(MOTOR_ANGLE));
+
+    double values[4] = {a - b, a + b, -a - b, b - a};
+    double largestValue = fmax(fmax(fmax(doubleAbs(values[0]), doubleAbs(values[1])), doubleAbs(values[2])), doubleAbs(values[3]));
+    double largestSpeed = 0;
+
+    for (int i = 0; i < 4; i++) {
+        speeds[i] = (int)round(values[i] * speed / largestValue) + rotation;
+        largestSpeed = fmax(largestSpeed, abs(speeds[i]));
+    }
+
+    if (largestSpeed > 255) {
+        for (int i = 0; i < 4; i++) {
+            speeds[i] = (int)round(speeds[i] * 255 / largestSpeed);
+        }
+    }
+}
+
+// What a motor was last told, from its pins
+static int wheelSpeed(int inOnePin, int inTwoPin, int pwmPin, bool reversed) {
+    if (digitalRead(inOnePin) && digitalRead(inTwoPin)) {
+        return 0;
+    }
+
+    int duty = analogRead(pwmPin);
+    return (bool)digitalRead(inOnePin) == reversed ? duty : -duty;
+}
+
+void test_mixing_matches_double_precision() {
+    static MotorArray motors;
+
+    for (int angle = -360; angle < 720; angle++) {
+        for (int rotation = -255; rotation <= 255; rotation += 5) {
+            for (int speed = 0; speed <= 255; speed += 5) {
+                motors.move(angle, rotation, speed, true);
+
+                int speeds[4] = {
+                    wheelSpeed(MOTOR_RIGHT_IN1, MOTOR_RIGHT_IN2, MOTOR_RIGHT_PWM, MOTOR_RIGHT_REVERSED),
+                    wheelSpeed(MOTOR_LEFT_IN1, MOTOR_LEFT_IN2, MOTOR_LEFT_PWM, MOTOR_LEFT_REVERSED),
+                    wheelSpeed(MOTOR_BACK_RIGHT_IN1, MOTOR_BACK_RIGHT_IN2, MOTOR_BACK_RIGHT_PWM, MOTOR_BACK_RIGHT_REVERSED),
+                    wheelSpeed(MOTOR_BACK_LEFT_IN1, MOTOR_BACK_LEFT_IN2, MOTOR_BACK_LEFT_PWM, MOTOR_BACK_LEFT_REVERSED)
+                };
+
+                int expected[4];
+                doubleMixing(angle, rotation, speed, expected);
+
+                for (int i = 0; i < 4; i++) {
+                    // Only rounding may differ, and nothing is clipped by the motor
+                    if (abs(speeds[i] - expected[i]) > 1 || abs(expected[i]) > 255) {
+                        char message[96];
+                        sprintf(message, "Wheel %d is %d not %d moving at %d with rotation %d and speed %d", i, speeds[i], expected[i], angle, rotation, speed);
+                        TEST_FAIL_MESSAGE(message);
+                    }
+                }
+            }
+        }
+    }
+}
+
+#define BENCHMARK_REPEATS 20
+
+void test_benchmark() {
+    int speeds[4];
+    volatile int sink = 0;
+
+    unsigned long startTime = micros();
+
+    for (int repeat = 0; repeat < BENCHMARK_REPEATS; repeat++) {
+        for (int angle = 0; angle < 360; angle++) {
+            for (int rotation = -100; rotation <= 100; rotation += 20) {
+                doubleMixing(angle, rotation, 255, speeds);
+                sink += speeds[repeat % 4];
+            }
+        }
+    }
+
+    unsigned long doubleTime = micros() - startTime;
+    startTime = micros();
+
+    for (int repeat = 0; repeat < BENCHMARK_REPEATS; repeat++) {
+        for (int angle = 0; angle < 360; angle++) {
+            for (int rotation = -100; rotation <= 100; rotation += 20) {
+                MotorArray::mix(angle, rotation, 255, speeds);
+                sink += speeds[repeat % 4];
+            }
+        }
+    }
+
+    unsigned long fixedTime = micros() - startTime;
+
+    // Every repeat mixes each angle with 11 rotations
+    double moves = BENCHMARK_REPEATS * 360 * 11;
+
+    char message[96];
+    sprintf(message, "Double %.1f ns, Q14 %.1f ns per move", doubleTime * 1000 / moves, fixedTime * 1000 / moves);
+    TEST_MESSAGE(message);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(test_mixing_matches_double_precision);
+    RUN_TEST(test_benchmark);
+    exit(UNITY_END());
+}
+
+void loop() {}
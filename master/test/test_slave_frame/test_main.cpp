@@ -0,0 +1,113 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <Slave.h>
+
+SlaveFrame frame;
+
+// A burst as the master sees it, two words late like the slave's ISR
+static void burst(volatile uint16_t *dataIn) {
+    uint16_t dataOut = 0;
+    uint16_t pushed = 0;
+
+    for (int i = 0; i < SLAVE_BURST_LENGTH; i++) {
+        dataIn[i] = pushed;
+        pushed = dataOut;
+
+        if (i == 0) {
+            frame.load();
+        }
+
+        dataOut = frame.next();
+    }
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_frame_round_trip() {
+    volatile uint16_t dataIn[SLAVE_BURST_LENGTH];
+    uint16_t data[SLAVE_FRAME_DATA_LENGTH];
+    uint16_t sequence;
+
+    for (int i = 0; i < 40; i++) {
+        uint16_t sent[SLAVE_FRAME_DATA_LENGTH] = {(uint16_t)(i * 1000), (uint16_t)(65535 - i), (uint16_t)(i * 7)};
+        frame.publish(sent);
+        burst(dataIn);
+
+        TEST_ASSERT_TRUE(SlaveFrame::unpack(dataIn, sequence, data));
+        TEST_ASSERT_EQUAL_INT((i + 1) % (1 << SLAVE_FRAME_SEQUENCE_BITS), sequence);
+
+        for (int j = 0; j < SLAVE_FRAME_DATA_LENGTH; j++) {
+            TEST_ASSERT_EQUAL_INT(sent[j], data[j]);
+        }
+    }
+}
+
+void test_corrupt_frame_rejected() {
+    volatile uint16_t dataIn[SLAVE_BURST_LENGTH];
+    uint16_t data[SLAVE_FRAME_DATA_LENGTH];
+    uint16_t sequence;
+
+    uint16_t sent[SLAVE_FRAME_DATA_LENGTH] = {12345, 300, 0};
+    frame.publish(sent);
+
+    // Every single bit error in the frame
+    for (int word = SLAVE_FRAME_OFFSET; word < SLAVE_BURST_LENGTH; word++) {
+        for (int bit = 0; bit < 16; bit++) {
+            burst(dataIn);
+            dataIn[word] ^= 1 << bit;
+
+            TEST_ASSERT_FALSE(SlaveFrame::unpack(dataIn, sequence, data));
+        }
+    }
+
+    // A slave that isn't answering
+    for (int i = 0; i < SLAVE_BURST_LENGTH; i++) {
+        dataIn[i] = 0;
+    }
+
+    TEST_ASSERT_FALSE(SlaveFrame::unpack(dataIn, sequence, data));
+
+    for (int i = 0; i < SLAVE_BURST_LENGTH; i++) {
+        dataIn[i] = 0xFFFF;
+    }
+
+    TEST_ASSERT_FALSE(SlaveFrame::unpack(dataIn, sequence, data));
+}
+
+void test_track_packing() {
+    int angles[] = {0, 1, 359, TSOP_NO_BALL};
+    int strengths[] = {0, 130, 1024, 2047};
+    int velocities[] = {INT16_MIN, -720, 0, 1, 720, INT16_MAX};
+    int ranges[] = {0, 25, 770, TSOP_NO_RANGE};
+
+    uint16_t data[SLAVE_FRAME_DATA_LENGTH];
+
+    for (int angle: angles) {
+        for (int strength: strengths) {
+            for (int velocity: velocities) {
+                for (int range: ranges) {
+                    SlaveTSOP::packTrack(angle, strength, velocity, range, data);
+                    BallData ball = SlaveTSOP::unpackTrack(data);
+
+                    TEST_ASSERT_EQUAL_INT(angle, ball.angle);
+                    TEST_ASSERT_EQUAL_INT(strength, ball.strength);
+                    TEST_ASSERT_EQUAL_INT(velocity, ball.angularVelocity);
+                    TEST_ASSERT_EQUAL_INT(range, ball.range);
+                    TEST_ASSERT_EQUAL(angle != TSOP_NO_BALL, ball.visible);
+                }
+            }
+        }
+    }
+}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(test_frame_round_trip);
+    RUN_TEST(test_corrupt_frame_rejected);
+    RUN_TEST(test_track_packing);
+    exit(UNITY_END());
+}
+
+void loop() {}
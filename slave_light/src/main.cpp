@@ -19,6 +19,12 @@ volatile uint16_t dataOut[1];
 
 LightSensorArray lightSensorArray;
 
+SlaveFrame frame;
+
+// The sensors for the app, sent on their own rather than in the frame
+volatile uint16_t first16Bit = 0;
+volatile uint16_t second16Bit = 0;
+
 Timer ledTimer = Timer(LED_BLINK_TIME_SLAVE_LIGHT);
 bool ledOn;
 
@@ -46,13 +52,22 @@ void debug() {
 }
 
 void loop() {
-    lightSensorArray.read();
-    lightSensorArray.calculateClusters();
-    lightSensorArray.calculateLine();
+    // The ADCs scan the sensors on their own, so only work when there's a new frame
+    if (lightSensorArray.frameReady()) {
+        lightSensorArray.read();
+        lightSensorArray.calculateClusters();
+        lightSensorArray.calculateLine();
 
-    #if DEBUG_LINE
-        debug();
-    #endif
+        uint16_t data[SLAVE_FRAME_DATA_LENGTH] = {(uint16_t)round(lightSensorArray.getLineAngle() * 100), (uint16_t)round(lightSensorArray.getLineSize() * 100), 0};
+        frame.publish(data);
+
+        first16Bit = lightSensorArray.getFirst16Bit();
+        second16Bit = lightSensorArray.getSecond16Bit();
+
+        #if DEBUG_LINE
+            debug();
+        #endif
+    }
 
     if (ledTimer.timeHasPassed()) {
         digitalWrite(LED_BUILTIN, ledOn);
@@ -66,23 +81,29 @@ void spi0_isr() {
 
     switch (command) {
         case SlaveCommand::lineAngle:
-            dataOut[0] = (uint16_t)round(lightSensorArray.getLineAngle() * 100);
+            dataOut[0] = frame.data(0);
             break;
 
         case SlaveCommand::lineSize:
-            dataOut[0] = (uint16_t)round(lightSensorArray.getLineSize() * 100);
+            dataOut[0] = frame.data(1);
             break;
 
         case SlaveCommand::lightSensorsFirst16Bit:
-            dataOut[0] = lightSensorArray.getFirst16Bit();
+            dataOut[0] = first16Bit;
             break;
 
         case SlaveCommand::lightSensorsSecond16Bit:
-            dataOut[0] = lightSensorArray.getSecond16Bit();
+            dataOut[0] = second16Bit;
+            break;
+
+        case SlaveCommand::snapshotFrame:
+            frame.load();
+            dataOut[0] = frame.next();
             break;
 
         default:
-            dataOut[0] = 0;
+            // Rest of a frame
+            dataOut[0] = frame.next();
             break;
     }
 }
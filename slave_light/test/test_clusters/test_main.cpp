@@ -0,0 +1,229 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <LightSensorArray.h>
+
+/* The cluster scan LS_BITMASK_CLUSTERS replaced, with its nested ifs for the
+ * first to fourth run folded into an index. Returns the number of clusters
+ */
+static int scanClusters(const bool *lightData, LightSensorCluster *clusters, bool doneFillInSensors) {
+    LightSensorCluster runs[4];
+    int current = 0;
+
+    for (int i = 0; i < 4; i++) {
+        runs[i] = LightSensorCluster(0.0, 0);
+    }
+
+    for (int i = 0; i < LS_NUM; i++) {
+        LightSensorCluster &run = runs[current];
+
+        if (lightData[i]) {
+            if (run.getLength() == 0) {
+                run = LightSensorCluster((double)i, 1);
+            } else {
+                run.addSensorClockwise();
+            }
+
+            if (current > 0 && i == 23 && runs[0].getLeftSensor() == 0) {
+                runs[0].addCluster(run);
+                run = LightSensorCluster(0.0, 0);
+            }
+        } else if (run.getLength() != 0) {
+            if (current < 3) {
+                current++;
+            } else if (!doneFillInSensors) {
+                bool filledInData[LS_NUM];
+
+                for (int j = 0; j < LS_NUM; j++) {
+                    filledInData[j] = lightData[j] || (lightData[mod(j - 1, LS_NUM)] && lightData[mod(j + 1, LS_NUM)]);
+                }
+
+                return scanClusters(filledInData, clusters, true);
+            } else {
+                runs[0] = runs[1] = runs[2] = LightSensorCluster(0.0, 0);
+                break;
+            }
+        }
+    }
+
+    int numClusters = 0;
+
+    for (int i = 0; i < 3; i++) {
+        clusters[i] = runs[i];
+        numClusters += runs[i].getLength() != 0;
+    }
+
+    return numClusters;
+}
+
+// The double precision line LS_LINE_TABLE replaced
+static void baselineLine(LightSensorCluster *clusters, int numClusters, double &angle, double &size) {
+    if (numClusters == 0) {
+        angle = NO_LINE_ANGLE;
+        size = NO_LINE_SIZE;
+        return;
+    }
+
+    double cluster1Angle = clusters[0].getAngle();
+    double cluster2Angle = clusters[1].getAngle();
+    double cluster3Angle = clusters[2].getAngle();
+
+    if (numClusters == 1) {
+        angle = cluster1Angle;
+        size = 1 - cos(degreesToRadians(angleBetween(clusters[0].getLeftAngle(), clusters[0].getRightAngle()) / 2.0));
+    } else if (numClusters == 2) {
+        angle = angleBetween(cluster1Angle, cluster2Angle) <= 180 ? midAngleBetween(cluster1Angle, cluster2Angle) : midAngleBetween(cluster2Angle, cluster1Angle);
+        size = 1 - cos(degreesToRadians(angleBetween(cluster1Angle, cluster2Angle) <= 180 ? angleBetween(cluster1Angle, cluster2Angle) / 2.0 : angleBetween(cluster2Angle, cluster1Angle) / 2.0));
+    } else {
+        double angleDiff12 = angleBetween(cluster1Angle, cluster2Angle);
+        double angleDiff23 = angleBetween(cluster2Angle, cluster3Angle);
+        double angleDiff31 = angleBetween(cluster3Angle, cluster1Angle);
+
+        double biggestAngle = max(angleDiff12, max(angleDiff23, angleDiff31));
+        double from, to;
+
+        if (angleDiff12 == biggestAngle) {
+            from = cluster2Angle;
+            to = cluster1Angle;
+        } else if (angleDiff23 == biggestAngle) {
+            from = cluster3Angle;
+            to = cluster2Angle;
+        } else {
+            from = cluster1Angle;
+            to = cluster3Angle;
+        }
+
+        angle = midAngleBetween(from, to);
+        size = angleBetween(from, to) <= 180 ? 1 - cos(degreesToRadians(angleBetween(from, to) / 2.0)) : 1;
+    }
+}
+
+static bool sameCluster(LightSensorCluster &a, LightSensorCluster &b) {
+    if (a.getLength() != b.getLength()) {
+        return false;
+    }
+
+    return a.getLength() == 0 || (a.getLeftSensor() == b.getLeftSensor() && a.getRightSensor() == b.getRightSensor());
+}
+
+void test_clusters_match_scan_for_every_mask() {
+    static LightSensorArray array;
+    double largestAngleError = 0;
+    double largestSizeError = 0;
+
+    for (uint32_t mask = 0; mask <= LS_MASK; mask++) {
+        bool lightData[LS_NUM];
+
+        for (int i = 0; i < LS_NUM; i++) {
+            lightData[i] = (mask >> i) & 1;
+            array.data[i] = lightData[i];
+        }
+
+        array.dataMask = mask;
+        array.calculateClusters();
+
+        LightSensorCluster expected[3];
+        int expectedClusters = scanClusters(lightData, expected, false);
+
+        if (array.numClusters != expectedClusters || !sameCluster(array.cluster1, expected[0]) || !sameCluster(array.cluster2, expected[1]) || !sameCluster(array.cluster3, expected[2])) {
+            char message[64];
+            sprintf(message, "Clusters differ from the scan for mask %06lx", (unsigned long)mask);
+            TEST_FAIL_MESSAGE(message);
+        }
+
+        double expectedAngle, expectedSize;
+        baselineLine(expected, expectedClusters, expectedAngle, expectedSize);
+
+        array.calculateLine();
+
+        double angleError = smallestAngleBetween(array.getLineAngle(), expectedAngle);
+        double sizeError = doubleAbs(array.getLineSize() - expectedSize);
+
+        // The line is sent in hundredths, so that is all that may differ
+        if (angleError > 0.01 || sizeError > 0.005) {
+            char message[96];
+            sprintf(message, "Line is %.2f, %.2f not %.4f, %.4f for mask %06lx", array.getLineAngle(), array.getLineSize(), expectedAngle, expectedSize, (unsigned long)mask);
+            TEST_FAIL_MESSAGE(message);
+        }
+
+        largestAngleError = max(largestAngleError, angleError);
+        largestSizeError = max(largestSizeError, sizeError);
+    }
+
+    char message[96];
+    sprintf(message, "Largest line angle error %.4f degrees, size error %.4f", largestAngleError, largestSizeError);
+    TEST_MESSAGE(message);
+}
+
+#define BENCHMARK_MASKS 4096
+#define BENCHMARK_REPEATS 50
+
+void test_benchmark() {
+    static LightSensorArray array;
+    static uint32_t masks[BENCHMARK_MASKS];
+    static bool lightData[BENCHMARK_MASKS][LS_NUM];
+    volatile double sink = 0;
+
+    // Up to three lines of up to six sensors, as seen on the field
+    srand(1);
+
+    for (int i = 0; i < BENCHMARK_MASKS; i++) {
+        masks[i] = 0;
+
+        for (int line = rand() % 4; line > 0; line--) {
+            int start = rand() % LS_NUM;
+
+            for (int length = 1 + rand() % 6; length > 0; length--) {
+                masks[i] |= 1UL << mod(start + length, LS_NUM);
+            }
+        }
+
+        for (int j = 0; j < LS_NUM; j++) {
+            lightData[i][j] = (masks[i] >> j) & 1;
+        }
+    }
+
+    unsigned long startTime = micros();
+
+    for (int repeat = 0; repeat < BENCHMARK_REPEATS; repeat++) {
+        for (int i = 0; i < BENCHMARK_MASKS; i++) {
+            LightSensorCluster clusters[3];
+            double angle, size;
+
+            baselineLine(clusters, scanClusters(lightData[i], clusters, false), angle, size);
+            sink += angle;
+        }
+    }
+
+    unsigned long baselineTime = micros() - startTime;
+    startTime = micros();
+
+    for (int repeat = 0; repeat < BENCHMARK_REPEATS; repeat++) {
+        for (int i = 0; i < BENCHMARK_MASKS; i++) {
+            array.dataMask = masks[i];
+            array.calculateClusters();
+            array.calculateLine();
+            sink += array.getLineAngle();
+        }
+    }
+
+    unsigned long maskTime = micros() - startTime;
+
+    double lines = BENCHMARK_REPEATS * BENCHMARK_MASKS;
+
+    char message[96];
+    sprintf(message, "Scan and double line %.1f ns, masks and line table %.1f ns per read", baselineTime * 1000 / lines, maskTime * 1000 / lines);
+    TEST_MESSAGE(message);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(test_clusters_match_scan_for_every_mask);
+    RUN_TEST(test_benchmark);
+    exit(UNITY_END());
+}
+
+void loop() {}
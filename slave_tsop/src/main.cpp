@@ -11,6 +11,7 @@
 #include <MoveData.h>
 #include <Slave.h>
 #include <Timer.h>
+#include <BallTracker.h>
 
 T3SPI spi;
 
@@ -18,10 +19,29 @@ volatile uint16_t dataIn[1];
 volatile uint16_t dataOut[1];
 
 TSOPArray tsops;
+IntervalTimer sampleTimer;
+
+BallTracker tracker;
+
+SlaveFrame frame;
+SlaveFrame trackFrame;
+SlaveFrame *sendingFrame = &frame;
+
+// Calibration requests from the master, handled outside the interrupt
+volatile bool startCalibration = false;
+volatile bool finishCalibration = false;
+volatile bool cancelCalibration = false;
 
 Timer ledTimer = Timer(LED_BLINK_TIME_SLAVE_TSOP);
 bool ledOn;
 
+void sampleTSOPs() {
+    // Stop at a full frame until the loop has finished it
+    if (tsops.tsopCounter < TSOP_READ_SAMPLES) {
+        tsops.updateOnce();
+    }
+}
+
 void setup() {
     Serial.begin(57600);
 
@@ -31,17 +51,41 @@ void setup() {
     NVIC_ENABLE_IRQ(IRQ_SPI0);
 
     tsops.init();
+    sampleTimer.begin(sampleTSOPs, TSOP_SAMPLE_TIME);
 
     pinMode(LED_BUILTIN, OUTPUT);
     digitalWrite(LED_BUILTIN, HIGH);
 }
 
 void loop() {
-    tsops.updateOnce();
+    if (startCalibration) {
+        tsops.startCalibration();
+        startCalibration = false;
+    }
 
-    if (tsops.tsopCounter > TSOP_LOOP_COUNT) {
+    if (finishCalibration) {
+        tsops.finishCalibration();
+        finishCalibration = false;
+    }
+
+    if (cancelCalibration) {
+        tsops.cancelCalibration();
+        cancelCalibration = false;
+    }
+
+    tsops.updateUnlock();
+
+    if (tsops.tsopCounter >= TSOP_READ_SAMPLES) {
         tsops.finishRead();
-        tsops.unlock();
+
+        uint16_t data[SLAVE_FRAME_DATA_LENGTH] = {(uint16_t)tsops.getAngle(), (uint16_t)tsops.getStrength(), 0};
+        frame.publish(data);
+
+        tracker.update(tsops.getAngle(), tsops.getStrength());
+
+        uint16_t trackData[SLAVE_FRAME_DATA_LENGTH];
+        SlaveTSOP::packTrack(tracker.getAngle(), tsops.getStrength(), tracker.getAngularVelocity(), tracker.getRange(), trackData);
+        trackFrame.publish(trackData);
     }
 
     if (ledTimer.timeHasPassed()) {
@@ -50,21 +94,68 @@ void loop() {
     }
 }
 
+BallData trackedBall() {
+    uint16_t data[SLAVE_FRAME_DATA_LENGTH];
+    trackFrame.read(data);
+
+    return SlaveTSOP::unpackTrack(data);
+}
+
 void spi0_isr() {
     spi.rxtx16(dataIn, dataOut, 1);
     int command = dataIn[0];
 
     switch (command) {
         case SlaveCommand::tsopAngle:
-            dataOut[0] = (uint16_t)tsops.getAngle();
+            dataOut[0] = frame.data(0);
             break;
 
         case SlaveCommand::tsopStrength:
-            dataOut[0] = (uint16_t)tsops.getStrength();
+            dataOut[0] = frame.data(1);
             break;
 
-        default:
+        case SlaveCommand::tsopTrackedAngle:
+            dataOut[0] = trackedBall().angle;
+            break;
+
+        case SlaveCommand::tsopAngularVelocity:
+            dataOut[0] = (uint16_t)trackedBall().angularVelocity;
+            break;
+
+        case SlaveCommand::tsopRange:
+            dataOut[0] = trackedBall().range;
+            break;
+
+        case SlaveCommand::snapshotFrame:
+            sendingFrame = &frame;
+            sendingFrame->load();
+            dataOut[0] = sendingFrame->next();
+            break;
+
+        case SlaveCommand::tsopTrackFrame:
+            sendingFrame = &trackFrame;
+            sendingFrame->load();
+            dataOut[0] = sendingFrame->next();
+            break;
+
+        case SlaveCommand::tsopStartCalibration:
+            startCalibration = true;
             dataOut[0] = 0;
             break;
+
+        case SlaveCommand::tsopFinishCalibration:
+            finishCalibration = true;
+            dataOut[0] = 0;
+            break;
+
+        case SlaveCommand::tsopCancelCalibration:
+            cancelCalibration = true;
+            dataOut[0] = 0;
+            break;
+
+        default:
+            // Rest of a frame
+            dataOut[0] = sendingFrame->next();
+            break;
     }
 }
@@ -0,0 +1,135 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <BallTracker.h>
+
+// A sub-frame of the sliding window and a whole read
+#define SUB_FRAME_TIME 330
+#define READ_TIME (SUB_FRAME_TIME * TSOP_SUB_FRAMES)
+
+// Degrees, the angle from one sub-frame's samples
+#define SUB_FRAME_NOISE 6
+
+#define BALL_SPEED 180
+
+class ClockBackend: public HALBackend {
+public:
+    uint32_t now = 0;
+
+    uint32_t micros() {
+        return now;
+    }
+};
+
+static uint32_t randomState = 1;
+
+static int randomInt(int min, int max) {
+    randomState = randomState * 1664525 + 1013904223;
+    return min + (int)((randomState >> 8) % (uint32_t)(max - min + 1));
+}
+
+/* Tracks a ball circling at BALL_SPEED, read every interval. Each read is the
+ * average of the last TSOP_SUB_FRAMES sub-frames like the sliding window, so
+ * reads every sub-frame share most of their noise. Returns the RMS error of
+ * the angular velocity once it has settled
+ */
+static double velocityError(int interval, double &meanVelocity) {
+    ClockBackend backend;
+    HAL::setBackend(&backend);
+
+    BallTracker tracker;
+    int noise[TSOP_SUB_FRAMES] = {0};
+    int subFrame = 0;
+
+    double total = 0;
+    double squares = 0;
+    int count = 0;
+
+    for (uint32_t time = 0; time < 3000000; time += SUB_FRAME_TIME) {
+        noise[subFrame] = randomInt(-SUB_FRAME_NOISE, SUB_FRAME_NOISE);
+        subFrame = (subFrame + 1) % TSOP_SUB_FRAMES;
+
+        if (time % interval != 0) {
+            continue;
+        }
+
+        int windowNoise = 0;
+
+        for (int i = 0; i < TSOP_SUB_FRAMES; i++) {
+            windowNoise += noise[i];
+        }
+
+        double ballAngle = BALL_SPEED * time / 1000000.0;
+
+        backend.now = time;
+        tracker.update(mod((int)round(ballAngle + (double)windowNoise / TSOP_SUB_FRAMES), 360), 150);
+
+        if (time >= 1000000) {
+            double error = tracker.getAngularVelocity() - BALL_SPEED;
+
+            total += tracker.getAngularVelocity();
+            squares += error * error;
+            count++;
+        }
+    }
+
+    meanVelocity = total / count;
+    return sqrt(squares / count);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_velocity_independent_of_read_rate() {
+    double subFrameMean, readMean;
+    double subFrameError = velocityError(SUB_FRAME_TIME, subFrameMean);
+    double readError = velocityError(READ_TIME, readMean);
+
+    char message[160];
+    sprintf(message, "Every sub-frame: %.1f deg/s mean, %.1f deg/s RMS error. Every read: %.1f deg/s mean, %.1f deg/s RMS error", subFrameMean, subFrameError, readMean, readError);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_FLOAT_WITHIN(5, BALL_SPEED, subFrameMean);
+    TEST_ASSERT_FLOAT_WITHIN(5, BALL_SPEED, readMean);
+
+    // Reading more often mustn't make the velocity, and so the orbit's lead, noisier
+    TEST_ASSERT_FLOAT_WITHIN(0.25 * readError, readError, subFrameError);
+}
+
+void test_range_independent_of_read_rate() {
+    // The strength steps down, the range should take as long to follow at either rate
+    int rangeTimes[2];
+    int intervals[2] = {SUB_FRAME_TIME, READ_TIME};
+
+    for (int i = 0; i < 2; i++) {
+        ClockBackend backend;
+        HAL::setBackend(&backend);
+
+        BallTracker tracker;
+        rangeTimes[i] = -1;
+
+        for (uint32_t time = 0; time < 200000; time += intervals[i]) {
+            backend.now = time;
+            tracker.update(0, time < 100000 ? 150 : 50);
+
+            if (time >= 100000 && rangeTimes[i] < 0 && tracker.getRange() > 100) {
+                rangeTimes[i] = time - 100000;
+            }
+        }
+    }
+
+    char message[80];
+    sprintf(message, "Range followed the strength in %d us every sub-frame, %d us every read", rangeTimes[0], rangeTimes[1]);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_INT_WITHIN(READ_TIME, rangeTimes[1], rangeTimes[0]);
+}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(test_velocity_independent_of_read_rate);
+    RUN_TEST(test_range_independent_of_read_rate);
+    exit(UNITY_END());
+}
+
+void loop() {}
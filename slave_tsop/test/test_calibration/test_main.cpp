@@ -0,0 +1,172 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <TSOPArray.h>
+
+static int tsopPins[TSOP_NUM] = {TSOP_0, TSOP_1, TSOP_2, TSOP_3, TSOP_4, TSOP_5, TSOP_6, TSOP_7, TSOP_8, TSOP_9, TSOP_10, TSOP_11, TSOP_12, TSOP_13, TSOP_14, TSOP_15, TSOP_16, TSOP_17, TSOP_18, TSOP_19, TSOP_20, TSOP_21, TSOP_22, TSOP_23};
+
+// Each TSOP is made more or less sensitive than it should be
+static double gain(int i) {
+    return 0.75 + 0.5 * ((i * 7) % TSOP_NUM) / (TSOP_NUM - 1);
+}
+
+static double offset(int i) {
+    return -15 + 30.0 * ((i * 11) % TSOP_NUM) / (TSOP_NUM - 1);
+}
+
+/* Reads every sub-frame of a window with TSOP i seeing IR in counts[i] of the
+ * samples, so values[i] ends up as counts[i]
+ */
+static void readWindow(TSOPArray &tsops, const int *counts) {
+    for (int subFrame = 0; subFrame < TSOP_SUB_FRAMES; subFrame++) {
+        for (int sample = 0; sample < TSOP_READ_SAMPLES; sample++) {
+            for (int i = 0; i < TSOP_NUM; i++) {
+                // The TSOP outputs are active low
+                digitalWrite(tsopPins[i], sample * TSOP_SUB_FRAMES + subFrame < counts[i] ? LOW : HIGH);
+            }
+
+            tsops.updateOnce();
+        }
+
+        tsops.finishRead();
+    }
+}
+
+// Every TSOP sees the same value, through its own gain and offset
+static void readUniform(TSOPArray &tsops, int value) {
+    int counts[TSOP_NUM];
+
+    for (int i = 0; i < TSOP_NUM; i++) {
+        counts[i] = (int)round(gain(i) * value + offset(i));
+    }
+
+    readWindow(tsops, counts);
+}
+
+// Reads the ball at ballAngle, with the TSOPs given only responding by brokenGain
+static void readBall(TSOPArray &tsops, int ballAngle, uint32_t brokenTSOPs = 0, double brokenGain = 0) {
+    int counts[TSOP_NUM];
+
+    for (int i = 0; i < TSOP_NUM; i++) {
+        double facing = max(cos(degreesToRadians(ballAngle - i * 360.0 / TSOP_NUM)), 0.0);
+        double response = (brokenTSOPs >> i) & 1 ? brokenGain : 1;
+        counts[i] = max((int)round(response * gain(i) * (30 + 150 * facing * facing) + offset(i)), 0);
+    }
+
+    readWindow(tsops, counts);
+}
+
+// Spins next to a ball with the TSOPs given broken
+static bool calibrate(TSOPArray &tsops, uint32_t brokenTSOPs = 0, double brokenGain = 0) {
+    tsops.startCalibration();
+
+    for (int ballAngle = 0; ballAngle < TSOP_CALIBRATION_TURNS * 360; ballAngle += 5) {
+        readBall(tsops, ballAngle, brokenTSOPs, brokenGain);
+    }
+
+    return tsops.finishCalibration();
+}
+
+// Mean and largest ball angle error in degrees over a turn of the ball
+static void angleErrors(TSOPArray &tsops, double &meanError, double &largestError) {
+    meanError = 0;
+    largestError = 0;
+
+    for (int ballAngle = 0; ballAngle < 360; ballAngle++) {
+        readBall(tsops, ballAngle);
+
+        double error = smallestAngleBetween(tsops.getAngle(), ballAngle);
+        meanError += error / 360;
+        largestError = max(largestError, error);
+    }
+}
+
+// How far the furthest TSOP is from value
+static int largestError(TSOPArray &tsops, int value) {
+    int error = 0;
+
+    for (int i = 0; i < TSOP_NUM; i++) {
+        error = max(error, abs(tsops.filteredValues[i] - value));
+    }
+
+    return error;
+}
+
+void test_calibration_evens_out_tsops() {
+    static TSOPArray tsops;
+    tsops.init();
+
+    int values[] = {80, 120, 160};
+
+    for (int value : values) {
+        readUniform(tsops, value);
+        TEST_ASSERT_TRUE_MESSAGE(largestError(tsops, value) > 10, "The TSOPs should differ before calibrating");
+    }
+
+    TEST_ASSERT_TRUE(calibrate(tsops));
+
+    for (int value : values) {
+        readUniform(tsops, value);
+        TEST_ASSERT_LESS_OR_EQUAL(3, largestError(tsops, value));
+    }
+}
+
+void test_broken_tsop_keeps_calibration() {
+    static TSOPArray tsops;
+    tsops.init();
+
+    TEST_ASSERT_TRUE(calibrate(tsops));
+    TEST_ASSERT_FALSE(calibrate(tsops, 1UL << 5));
+
+    // The first calibration is still in use
+    readUniform(tsops, 120);
+    TEST_ASSERT_LESS_OR_EQUAL(3, largestError(tsops, 120));
+}
+
+void test_weak_tsop_rejects_calibration() {
+    static TSOPArray tsops;
+    tsops.init();
+
+    // A gain of about 8 would overflow the Q12 gain
+    TEST_ASSERT_FALSE(calibrate(tsops, 1UL << 5, 0.12));
+
+    // A TSOP a little weaker than the rest is still calibrated
+    TEST_ASSERT_TRUE(calibrate(tsops, 1UL << 5, 0.6));
+}
+
+void test_calibration_improves_angle() {
+    static TSOPArray tsops;
+    tsops.init();
+
+    double meanBefore, largestBefore, meanAfter, largestAfter;
+    angleErrors(tsops, meanBefore, largestBefore);
+
+    TEST_ASSERT_TRUE(calibrate(tsops));
+    angleErrors(tsops, meanAfter, largestAfter);
+
+    char message[120];
+    sprintf(message, "Angle error before: mean %.2f, largest %.2f degrees. After: mean %.2f, largest %.2f degrees",
+            meanBefore, largestBefore, meanAfter, largestAfter);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_TRUE_MESSAGE(meanAfter < meanBefore, message);
+    TEST_ASSERT_TRUE_MESSAGE(largestAfter < largestBefore, message);
+}
+
+void setUp() {
+    // Nothing stored, so every TSOP starts uncalibrated
+    TSOPCalibration calibration = {};
+    EEPROM.put(TSOP_CALIBRATION_EEPROM, calibration);
+}
+
+void tearDown() {}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(test_calibration_evens_out_tsops);
+    RUN_TEST(test_broken_tsop_keeps_calibration);
+    RUN_TEST(test_weak_tsop_rejects_calibration);
+    RUN_TEST(test_calibration_improves_angle);
+    exit(UNITY_END());
+}
+
+void loop() {}
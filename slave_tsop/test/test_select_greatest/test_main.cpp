@@ -0,0 +1,138 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <TSOPArray.h>
+
+#define FRAMES 500000
+#define BENCHMARK_FRAMES 4096
+#define BENCHMARK_REPEATS 100
+
+// The insertion sort of every TSOP selectGreatest replaced
+static void sortValues(const int *values, int (&sortedValues)[TSOP_NUM], int (&indexes)[TSOP_NUM]) {
+    for (int i = 0; i < TSOP_NUM; i++) {
+        sortedValues[i] = 0;
+        indexes[i] = 0;
+    }
+
+    for (int i = 0; i < TSOP_NUM; i++) {
+        for (int j = 0; j < TSOP_NUM; j++) {
+            if (values[i] > sortedValues[j]) {
+                if (j <= i) {
+                    ARRAYSHIFTDOWN(sortedValues, j, i);
+                    ARRAYSHIFTDOWN(indexes, j, i);
+                }
+
+                sortedValues[j] = values[i];
+                indexes[j] = i;
+                break;
+            }
+        }
+    }
+}
+
+static uint32_t randomState = 1;
+
+static int randomInt(int max) {
+    randomState = randomState * 1664525 + 1013904223;
+    return (randomState >> 8) % max;
+}
+
+// Frames with few ties, many ties, mostly zeros and two values only
+static void randomFrame(int *values, int kind) {
+    for (int i = 0; i < TSOP_NUM; i++) {
+        switch (kind % 4) {
+            case 0: values[i] = randomInt(256); break;
+            case 1: values[i] = randomInt(4); break;
+            case 2: values[i] = randomInt(3) == 0 ? randomInt(30) : 0; break;
+            default: values[i] = randomInt(2) * 200; break;
+        }
+    }
+}
+
+template <int K>
+static void checkAgainstSort() {
+    for (int frame = 0; frame < FRAMES; frame++) {
+        int values[TSOP_NUM];
+        randomFrame(values, frame);
+
+        int sortedValues[TSOP_NUM];
+        int sortedIndexes[TSOP_NUM];
+        sortValues(values, sortedValues, sortedIndexes);
+
+        int greatestValues[K];
+        int greatestIndexes[K];
+        selectGreatest<K, TSOP_NUM>(values, greatestValues, greatestIndexes);
+
+        for (int i = 0; i < K; i++) {
+            if (greatestValues[i] != sortedValues[i] || greatestIndexes[i] != sortedIndexes[i]) {
+                char message[64];
+                sprintf(message, "Place %d of frame %d differs from the sort", i, frame);
+                TEST_FAIL_MESSAGE(message);
+            }
+        }
+    }
+}
+
+void test_select_one() {
+    checkAgainstSort<1>();
+}
+
+void test_select_best() {
+    checkAgainstSort<TSOP_BEST_TSOP_NO>();
+}
+
+void test_select_all() {
+    checkAgainstSort<TSOP_NUM>();
+}
+
+void test_benchmark() {
+    static int frames[BENCHMARK_FRAMES][TSOP_NUM];
+    volatile int sink = 0;
+
+    for (int frame = 0; frame < BENCHMARK_FRAMES; frame++) {
+        randomFrame(frames[frame], frame);
+    }
+
+    unsigned long startTime = micros();
+
+    for (int repeat = 0; repeat < BENCHMARK_REPEATS; repeat++) {
+        for (int frame = 0; frame < BENCHMARK_FRAMES; frame++) {
+            int sortedValues[TSOP_NUM];
+            int sortedIndexes[TSOP_NUM];
+            sortValues(frames[frame], sortedValues, sortedIndexes);
+            sink += sortedIndexes[0];
+        }
+    }
+
+    unsigned long sortTime = micros() - startTime;
+    startTime = micros();
+
+    for (int repeat = 0; repeat < BENCHMARK_REPEATS; repeat++) {
+        for (int frame = 0; frame < BENCHMARK_FRAMES; frame++) {
+            int greatestValues[TSOP_BEST_TSOP_NO];
+            int greatestIndexes[TSOP_BEST_TSOP_NO];
+            selectGreatest<TSOP_BEST_TSOP_NO, TSOP_NUM>(frames[frame], greatestValues, greatestIndexes);
+            sink += greatestIndexes[0];
+        }
+    }
+
+    unsigned long selectTime = micros() - startTime;
+
+    char message[96];
+    sprintf(message, "Sort %.1f ns, selectGreatest %.1f ns per frame", sortTime * 1000.0 / (BENCHMARK_FRAMES * BENCHMARK_REPEATS), selectTime * 1000.0 / (BENCHMARK_FRAMES * BENCHMARK_REPEATS));
+    TEST_MESSAGE(message);
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(test_select_one);
+    RUN_TEST(test_select_best);
+    RUN_TEST(test_select_all);
+    RUN_TEST(test_benchmark);
+    exit(UNITY_END());
+}
+
+void loop() {}
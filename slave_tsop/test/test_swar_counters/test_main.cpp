@@ -0,0 +1,134 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <Common.h>
+#include <Config.h>
+
+#define FRAMES 20000
+#define BENCHMARK_REPEATS 20000
+
+static uint32_t randomState = 1;
+
+static uint32_t randomSample() {
+    randomState ^= randomState << 13;
+    randomState ^= randomState >> 17;
+    randomState ^= randomState << 5;
+    return randomState & ((1UL << TSOP_NUM) - 1);
+}
+
+// A frame of samples, some sparse, some dense and some with every TSOP always on
+static void randomFrame(uint32_t *samples, int n, int kind) {
+    for (int k = 0; k < n; k++) {
+        switch (kind % 4) {
+            case 0: samples[k] = randomSample(); break;
+            case 1: samples[k] = randomSample() & randomSample() & randomSample(); break;
+            case 2: samples[k] = randomSample() | randomSample() | randomSample(); break;
+            default: samples[k] = (1UL << TSOP_NUM) - 1; break;
+        }
+    }
+}
+
+// How the TSOPs were counted before, an add per TSOP per sample
+static void addCounts(const uint32_t *samples, int n, int *counts) {
+    for (int i = 0; i < TSOP_NUM; i++) {
+        counts[i] = 0;
+    }
+
+    for (int k = 0; k < n; k++) {
+        for (int i = 0; i < TSOP_NUM; i++) {
+            counts[i] += (samples[k] >> i) & 1;
+        }
+    }
+}
+
+template <int B>
+static void swarCounts(const uint32_t *samples, int n, int *counts) {
+    uint32_t planes[B] = {0};
+
+    for (int k = 0; k < n; k++) {
+        addToCounters<B>(planes, samples[k]);
+    }
+
+    for (int i = 0; i < TSOP_NUM; i++) {
+        counts[i] = counterValue<B>(planes, i);
+    }
+}
+
+template <int B, int N>
+static void checkAgainstAdds() {
+    static uint32_t samples[N];
+
+    for (int frame = 0; frame < FRAMES; frame++) {
+        randomFrame(samples, N, frame);
+
+        int expected[TSOP_NUM];
+        int actual[TSOP_NUM];
+        addCounts(samples, N, expected);
+        swarCounts<B>(samples, N, actual);
+
+        for (int i = 0; i < TSOP_NUM; i++) {
+            if (actual[i] != expected[i]) {
+                char message[64];
+                sprintf(message, "TSOP %d of frame %d counted %d not %d", i, frame, actual[i], expected[i]);
+                TEST_FAIL_MESSAGE(message);
+            }
+        }
+    }
+}
+
+template <int B, int N>
+static void benchmark() {
+    static uint32_t samples[N];
+    int counts[TSOP_NUM];
+    volatile int sink = 0;
+
+    randomFrame(samples, N, 0);
+
+    unsigned long startTime = micros();
+
+    for (int repeat = 0; repeat < BENCHMARK_REPEATS; repeat++) {
+        addCounts(samples, N, counts);
+        sink += counts[repeat % TSOP_NUM];
+    }
+
+    unsigned long addTime = micros() - startTime;
+    startTime = micros();
+
+    for (int repeat = 0; repeat < BENCHMARK_REPEATS; repeat++) {
+        swarCounts<B>(samples, N, counts);
+        sink += counts[repeat % TSOP_NUM];
+    }
+
+    unsigned long swarTime = micros() - startTime;
+
+    char message[96];
+    sprintf(message, "%d samples: adds %.2f us, SWAR %.2f us per frame", N, (double)addTime / BENCHMARK_REPEATS, (double)swarTime / BENCHMARK_REPEATS);
+    TEST_MESSAGE(message);
+}
+
+void test_counts_whole_read() {
+    // A whole read of TSOP_LOOP_COUNT + 1 samples, as configured
+    checkAgainstAdds<TSOP_COUNTER_BITS, TSOP_LOOP_COUNT + 1>();
+}
+
+void test_counts_1024() {
+    checkAgainstAdds<11, 1024>();
+}
+
+void test_benchmark() {
+    benchmark<TSOP_COUNTER_BITS, TSOP_LOOP_COUNT + 1>();
+    benchmark<11, 1024>();
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(test_counts_whole_read);
+    RUN_TEST(test_counts_1024);
+    RUN_TEST(test_benchmark);
+    exit(UNITY_END());
+}
+
+void loop() {}
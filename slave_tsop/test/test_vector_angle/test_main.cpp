@@ -0,0 +1,171 @@
+#include <Arduino.h>
+#include <unity.h>
+#include <TSOPArray.h>
+
+// Whole degrees are within half a degree plus atan2Degrees' own error
+#define MAX_ERROR 0.6
+
+static uint32_t randomState = 1;
+
+static int randomInt(int min, int max) {
+    randomState = randomState * 1664525 + 1013904223;
+    return min + (int)((randomState >> 8) % (uint32_t)(max - min + 1));
+}
+
+static double angleError(double angle, double expected) {
+    double difference = fmod(fabs(angle - expected), 360);
+    return difference > 180 ? 360 - difference : difference;
+}
+
+static double floatingAtan2Degrees(double y, double x) {
+    return fmod(radiansToDegrees(atan2(y, x)) + 360, 360);
+}
+
+void test_atan2_degrees() {
+    for (int i = 0; i < 1000000; i++) {
+        // Small vectors as well as large ones
+        int range = i % 2 == 0 ? 100 : 2000000;
+        int y = randomInt(-range, range);
+        int x = randomInt(-range, range);
+
+        if (x == 0 && y == 0) {
+            continue;
+        }
+
+        double error = angleError(atan2Degrees(y, x), floatingAtan2Degrees(y, x));
+
+        if (error > MAX_ERROR) {
+            char message[80];
+            sprintf(message, "atan2Degrees(%d, %d) is %.2f degrees out", y, x, error);
+            TEST_FAIL_MESSAGE(message);
+        }
+    }
+}
+
+void test_vector_angle_matches_floating_point() {
+    static TSOPArray tsops;
+    tsops.loadCalibration();
+
+    double totalError = 0;
+    double maxError = 0;
+    int frames = 0;
+
+    // A ball every half a degree seen through cos^2 TSOPs with some noise
+    for (int ball = 0; ball < 720; ball++) {
+        for (int repeat = 0; repeat < 10; repeat++) {
+            for (int i = 0; i < TSOP_NUM; i++) {
+                double facing = max(cos(degreesToRadians(ball / 2.0 - i * 360.0 / TSOP_NUM)), 0.0);
+                tsops.values[i] = constrain((int)(200 * facing * facing) + randomInt(-8, 8), 0, 255);
+            }
+
+            tsops.sortFilterValues();
+            tsops.calculateAngleVector();
+
+            double x = 0;
+            double y = 0;
+
+            for (int i = 0; i < TSOP_NUM; i++) {
+                x += tsops.filteredValues[i] * sin(degreesToRadians(i * 360.0 / TSOP_NUM));
+                y += tsops.filteredValues[i] * cos(degreesToRadians(i * 360.0 / TSOP_NUM));
+            }
+
+            double error = angleError(tsops.getAngle(), floatingAtan2Degrees(x, y));
+
+            if (error > MAX_ERROR) {
+                char message[80];
+                sprintf(message, "Ball at %.1f degrees is %.2f degrees from floating point", ball / 2.0, error);
+                TEST_FAIL_MESSAGE(message);
+            }
+
+            totalError += error;
+            maxError = max(maxError, error);
+            frames++;
+        }
+    }
+
+    char message[80];
+    sprintf(message, "Mean %.3f, max %.3f degrees from floating point", totalError / frames, maxError);
+    TEST_MESSAGE(message);
+}
+
+#define BENCHMARK_REPEATS 200
+
+void test_vector_angle_against_index_average() {
+    static TSOPArray tsops;
+    tsops.loadCalibration();
+
+    double indexTotalError = 0, indexMaxError = 0;
+    double vectorTotalError = 0, vectorMaxError = 0;
+    unsigned long indexTime = 0, vectorTime = 0;
+    volatile int sink = 0;
+    int frames = 0;
+
+    // Error from where the ball really is, with the same frames for both
+    for (int ball = 0; ball < 720; ball++) {
+        for (int repeat = 0; repeat < 10; repeat++) {
+            for (int i = 0; i < TSOP_NUM; i++) {
+                double facing = max(cos(degreesToRadians(ball / 2.0 - i * 360.0 / TSOP_NUM)), 0.0);
+                tsops.values[i] = constrain((int)(200 * facing * facing) + randomInt(-8, 8), 0, 255);
+            }
+
+            tsops.sortFilterValues();
+
+            tsops.calculateAngle(TSOP_BEST_TSOP_NO_ANGLE);
+            double indexError = angleError(tsops.getAngle(), ball / 2.0);
+
+            tsops.calculateAngleVector();
+            double vectorError = angleError(tsops.getAngle(), ball / 2.0);
+
+            indexTotalError += indexError;
+            indexMaxError = max(indexMaxError, indexError);
+            vectorTotalError += vectorError;
+            vectorMaxError = max(vectorMaxError, vectorError);
+            frames++;
+
+            // Each estimator on its own, many times over to be measurable
+            if (repeat == 0) {
+                unsigned long startTime = micros();
+
+                for (int call = 0; call < BENCHMARK_REPEATS; call++) {
+                    tsops.calculateAngle(TSOP_BEST_TSOP_NO_ANGLE);
+                    sink += tsops.getAngle();
+                }
+
+                indexTime += micros() - startTime;
+                startTime = micros();
+
+                for (int call = 0; call < BENCHMARK_REPEATS; call++) {
+                    tsops.calculateAngleVector();
+                    sink += tsops.getAngle();
+                }
+
+                vectorTime += micros() - startTime;
+            }
+        }
+    }
+
+    double calls = 720.0 * BENCHMARK_REPEATS;
+
+    char message[128];
+    sprintf(message, "Index average: mean %.2f, max %.2f degrees, %.1f ns per call", indexTotalError / frames, indexMaxError, indexTime * 1000 / calls);
+    TEST_MESSAGE(message);
+    sprintf(message, "Vector sum: mean %.2f, max %.2f degrees, %.1f ns per call", vectorTotalError / frames, vectorMaxError, vectorTime * 1000 / calls);
+    TEST_MESSAGE(message);
+
+    TEST_ASSERT_TRUE_MESSAGE(vectorTotalError < indexTotalError, "The vector sum should be more accurate than the index average");
+    TEST_ASSERT_TRUE_MESSAGE(vectorMaxError < indexMaxError, "The vector sum should be more accurate than the index average");
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void setup() {
+    UNITY_BEGIN();
+    RUN_TEST(test_atan2_degrees);
+    RUN_TEST(test_vector_angle_matches_floating_point);
+    RUN_TEST(test_vector_angle_against_index_average);
+    exit(UNITY_END());
+}
+
+void loop() {}